@@ -1,10 +1,39 @@
+// Audit builds of the standalone app install the real-time checks, see CelestialSynth_RealtimeAudit.h
+#if defined(APP_API) && CELESTIAL_RT_AUDIT
+  #define CELESTIAL_RT_AUDIT_IMPLEMENT
+#endif
 #include "CelestialSynth.h"
 #include "IPlug_include_in_plug_src.h"
 #include "IControls.h"
+#if IPLUG_EDITOR
+#include "CelestialSynth_SpectrumControl.h"
+#include "CelestialSynth_ConstellationControl.h"
+#include "CelestialSynth_LayerControl.h"
+#include "CelestialSynth_LoadMeterControl.h"
+#endif
 
 using namespace iplug;
 using namespace igraphics;
 
+static_assert(PresetMorpher::kNumFactoryPresets == kNumPresets, "Factory bank and kNumPresets disagree");
+
+// The parameter behind each preset slot
+static const int kPresetSlotParams[kNumPresetSlots] = {
+  kParamBrilliance, kParamMotion, kParamSpace, kParamWarmth, kParamPurity, kParamGravity,
+  kParamTimbreShift, kParamHarmonicBlend, kParamGain, kParamUnisonDetune, kParamUnisonWidth,
+  kParamVoices, kParamScaleType, kParamUnisonVoices, kParamGlideMode
+};
+
+static int GetPresetSlot(int paramIdx)
+{
+  for (int s = 0; s < kNumPresetSlots; s++)
+  {
+    if (kPresetSlotParams[s] == paramIdx)
+      return s;
+  }
+  return -1;
+}
+
 CelestialSynth::CelestialSynth(const InstanceInfo& info)
 : Plugin(info, MakeConfig(kNumParams, kNumPresets))
 {
@@ -27,6 +56,41 @@ CelestialSynth::CelestialSynth(const InstanceInfo& info)
   // Global controls
   GetParam(kParamGain)->InitDouble("Gain", 0.5, 0.0, 1.0, 0.01, "");
   GetParam(kParamMPEEnable)->InitBool("MPE Enable", false);
+  GetParam(kParamOutputRouting)->InitEnum("Output Routing", 0, {"Main", "Note Range", "MIDI Channel", "Velocity Layers"});
+
+  // Unison
+  GetParam(kParamUnisonVoices)->InitInt("Unison", 1, 1, 8, "");
+  GetParam(kParamUnisonDetune)->InitDouble("Unison Detune", 15.0, 0.0, 50.0, 0.1, "cents");
+  GetParam(kParamUnisonWidth)->InitDouble("Unison Width", 0.7, 0.0, 1.0, 0.01, "");
+
+  // How Gravity glides are applied
+  GetParam(kParamGlideMode)->InitEnum("Glide Mode", 0, {"Poly", "Mono", "Legato"});
+
+  // Preset morph, blends the current sound towards another factory preset
+  GetParam(kParamMorphTarget)->InitEnum("Morph Target", 0, kNumPresets, "", IParam::kFlagsNone, "");
+  for (int i = 0; i < kNumPresets; i++)
+    GetParam(kParamMorphTarget)->SetDisplayText(i, kFactoryPresets[i].name);
+  GetParam(kParamMorphAmount)->InitDouble("Morph", 0.0, 0.0, 1.0, 0.01, "");
+
+  // Convolution
+  GetParam(kParamConvolutionMix)->InitDouble("IR Mix", 0.5, 0.0, 1.0, 0.01, "");
+
+#if IPLUG_DSP
+  // Factory bank. Each preset is its slot values over the defaults, stored as a parameter-only state
+  // chunk so recalling one leaves the tuning, splits and IR alone.
+  for (const CelestialPreset& preset : kFactoryPresets)
+  {
+    for (int s = 0; s < kNumPresetSlots; s++)
+      GetParam(kPresetSlotParams[s])->Set(preset.values[s]);
+
+    IByteChunk chunk;
+    WriteStateChunk(chunk, false);
+    MakePresetFromChunk(preset.name, chunk);
+  }
+
+  for (int i = 0; i < kNumParams; i++)
+    GetParam(i)->SetToDefault();
+#endif
 
 #if IPLUG_EDITOR // http://bit.ly/2S64BDd
   mMakeGraphicsFunc = [&]() {
@@ -43,22 +107,30 @@ CelestialSynth::CelestialSynth(const InstanceInfo& info)
     const IColor accentGold = IColor(255, 255, 215, 138); // Golden accent
     const IColor panelBg = IColor(255, 35, 35, 40); // Dark panel
     
-    // Main background
-    pGraphics->AttachControl(new IPanelControl(bounds, darkBg));
-    
-    // Title Section with celestial styling
-    pGraphics->AttachControl(new ITextControl(IRECT(0, 20, bounds.W(), 70), "✦ CELESTIAL PENTATONIC SYNTHESIZER ✦", 
-      IText(24, accentGold, "Roboto-Regular", EAlign::Center, EVAlign::Middle)));
-    
     // Five Sacred Controls Section
     const IRECT sacredSection = IRECT(50, 100, bounds.W() - 50, 350);
     
-    // Sacred Controls Panel Background
-    pGraphics->AttachControl(new IPanelControl(sacredSection, panelBg));
+    // Additional Controls Section
+    const IRECT additionalSection = IRECT(50, 370, bounds.W() - 50, bounds.H() - 30);
     
-    // Sacred Controls Label
-    pGraphics->AttachControl(new ITextControl(IRECT(sacredSection.L + 20, sacredSection.T + 10, sacredSection.R - 20, sacredSection.T + 35), 
-      "THE FIVE SACRED CONTROLS", IText(14, accentGold, "Roboto-Regular", EAlign::Center, EVAlign::Middle)));
+    // Background, title, section panels and labels never change, so they are drawn once into a
+    // cached layer. Only the controls on top repaint, and only where they changed.
+    pGraphics->AttachControl(new CelestialStaticLayerControl(bounds, [=](IGraphics& g, const IRECT& r) {
+      g.FillRect(darkBg, r);
+      
+      // Title Section with celestial styling
+      g.DrawText(IText(24, accentGold, "Roboto-Regular", EAlign::Center, EVAlign::Middle), "✦ CELESTIAL PENTATONIC SYNTHESIZER ✦", IRECT(0, 20, r.W(), 70));
+      
+      // Sacred Controls Panel and Label
+      g.FillRect(panelBg, sacredSection);
+      g.DrawText(IText(14, accentGold, "Roboto-Regular", EAlign::Center, EVAlign::Middle), "THE FIVE SACRED CONTROLS",
+                 IRECT(sacredSection.L + 20, sacredSection.T + 10, sacredSection.R - 20, sacredSection.T + 35));
+      
+      // Additional Controls Panel and Label
+      g.FillRect(panelBg, additionalSection);
+      g.DrawText(IText(12, accentGold, "Roboto-Regular", EAlign::Center, EVAlign::Middle), "SYNTHESIS PARAMETERS",
+                 IRECT(additionalSection.L + 20, additionalSection.T + 10, additionalSection.R - 20, additionalSection.T + 30));
+    }));
     
     // Sacred Controls - Beautiful knobs with proper spacing
     const float knobSize = 90;
@@ -98,16 +170,6 @@ CelestialSynth::CelestialSynth(const InstanceInfo& info)
     pGraphics->AttachControl(new IVKnobControl(IRECT(spacing * 5 + knobSize * 4, knobY, spacing * 5 + knobSize * 5, knobY + knobSize), 
                                                kParamPurity, "PURITY", purityStyle), kCtrlPurity);
     
-    // Additional Controls Section
-    const IRECT additionalSection = IRECT(50, 370, bounds.W() - 50, bounds.H() - 30);
-    
-    // Additional Controls Panel
-    pGraphics->AttachControl(new IPanelControl(additionalSection, panelBg));
-    
-    // Additional Controls Label
-    pGraphics->AttachControl(new ITextControl(IRECT(additionalSection.L + 20, additionalSection.T + 10, additionalSection.R - 20, additionalSection.T + 30), 
-      "SYNTHESIS PARAMETERS", IText(12, accentGold, "Roboto-Regular", EAlign::Center, EVAlign::Middle)));
-    
     // Smaller knobs for additional parameters
     const float smallKnobSize = 55;
     const float colSpacing = 110;
@@ -150,10 +212,87 @@ CelestialSynth::CelestialSynth(const InstanceInfo& info)
     pGraphics->AttachControl(new IVToggleControl(IRECT(startX + colSpacing * 3, row2Y, startX + colSpacing * 4 - 10, row2Y + 25), 
                                                  kParamMPEEnable, "MPE MODE", 
                                                  DEFAULT_STYLE.WithColor(kFG, accentBlue)), kCtrlMPE);
+
+    // Convolution row: load and clear the IR, its file name, and the wet mix
+    const float row3Y = row2Y + 35;
+    const IVStyle irButtonStyle = DEFAULT_STYLE.WithColor(kFG, accentGold).WithLabelText(IText(9, COLOR_BLACK, "Roboto-Regular", EAlign::Center));
+
+#if IPLUG_DSP
+    pGraphics->AttachControl(new IVButtonControl(IRECT(startX, row3Y, startX + 80, row3Y + 22), [this](IControl* pCaller) {
+      SplashClickActionFunc(pCaller);
+      WDL_String fileName, path;
+      pCaller->GetUI()->PromptForFile(fileName, path, EFileAction::Open, "wav", [this](const WDL_String& chosen, const WDL_String&) {
+        // Read and transformed on the convolution loader thread, the label follows from OnIdle
+        if (chosen.GetLength())
+          mDSP.LoadImpulseResponseAsync(chosen.Get());
+      });
+    }, "LOAD IR", irButtonStyle));
+
+    pGraphics->AttachControl(new IVButtonControl(IRECT(startX + 90, row3Y, startX + 150, row3Y + 22), [this](IControl* pCaller) {
+      SplashClickActionFunc(pCaller);
+      mDSP.ClearImpulseResponse();
+    }, "CLEAR", irButtonStyle));
+#endif
+
+    pGraphics->AttachControl(new ITextControl(IRECT(startX + 160, row3Y, startX + colSpacing * 3 - 10, row3Y + 22), "NO IR",
+                                              IText(10, COLOR_LIGHT_GRAY, "Roboto-Regular", EAlign::Near), panelBg), kCtrlImpulseName);
+
+    pGraphics->AttachControl(new ITextControl(IRECT(startX + colSpacing * 3, row3Y, startX + colSpacing * 3 + 45, row3Y + 22), "IR MIX",
+                                              IText(9, COLOR_LIGHT_GRAY, "Roboto-Regular", EAlign::Near), panelBg));
+
+    pGraphics->AttachControl(new IVSliderControl(IRECT(startX + colSpacing * 3 + 50, row3Y, startX + colSpacing * 4 + smallKnobSize, row3Y + 22),
+                                                 kParamConvolutionMix, "", smallKnobStyle.WithShowLabel(false), false, EDirection::Horizontal));
+
+#if IPLUG_DSP
+    // Spectrum of the main output with the current scale's pitches marked, analysed on the UI thread
+    auto scaleMarkers = [this](double* freqs, int maxMarkers) {
+      PentatonicScaleSystem scale;
+      scale.SetScale((PentatonicScaleSystem::ScaleType)GetParam(kParamScaleType)->Int());
+      double ratios[PentatonicScaleSystem::kNumDegrees];
+      if (mDSP.GetCustomTuning(ratios))
+        scale.SetCustomRatios(ratios);
+
+      int n = 0;
+      for (int octave = -4; octave <= 6; octave++)
+      {
+        for (int d = 0; d < PentatonicScaleSystem::kNumDegrees && n < maxMarkers; d++)
+          freqs[n++] = 261.6256 * scale.GetRatio(d) * std::pow(2.0, octave);
+      }
+      return n;
+    };
+
+    // Visual strip under the sacred knobs: spectrum on the left, the voice constellation on the right
+    const IRECT visualStrip = IRECT(sacredSection.L + 20, knobY + knobSize + 20, sacredSection.R - 20, sacredSection.B - 10);
+    const float spectrumRight = visualStrip.L + visualStrip.W() * 0.62f;
+
+    pGraphics->AttachControl(new CelestialSpectrumControl(IRECT(visualStrip.L, visualStrip.T, spectrumRight, visualStrip.B),
+                                                          mSpectrumTap, scaleMarkers, accentBlue, accentGold.WithOpacity(0.35f)), kCtrlSpectrum);
+
+    pGraphics->AttachControl(new CelestialConstellationControl(IRECT(spectrumRight + 10, visualStrip.T, visualStrip.R, visualStrip.B),
+                                                               [this](CelestialVoiceSnapshot& snapshot) { return mDSP.ReadVoiceSnapshot(snapshot); },
+                                                               accentBlue.WithOpacity(0.3f)), kCtrlConstellation);
+#endif
+
+    // Output meter, peak and RMS per channel, fed from the audio thread through mMeterSender
+    pGraphics->AttachControl(new IVPeakAvgMeterControl<2>(IRECT(additionalSection.R - 70, additionalSection.T + 40, additionalSection.R - 20, additionalSection.B - 15),
+                                                          "", DEFAULT_STYLE.WithColor(kFG, accentBlue).WithShowLabel(false)), kCtrlMeter);
+
+    // DSP load per stage, fed through mLoadSender
+    pGraphics->AttachControl(new CelestialLoadMeterControl(IRECT(additionalSection.R - 160, additionalSection.T + 40, additionalSection.R - 80, additionalSection.T + 160),
+                                                           accentBlue, accentGold), kCtrlLoadMeter);
   };
 #endif
 }
 
+#if CELESTIAL_TRACE
+CelestialSynth::~CelestialSynth()
+{
+  // Trace builds leave what the probes recorded where CELESTIAL_TRACE_FILE points
+  if (const char* path = getenv("CELESTIAL_TRACE_FILE"))
+    CelestialTrace::WriteChromeJSON(path);
+}
+#endif
+
 #if IPLUG_EDITOR
 void CelestialSynth::OnMidiMsgUI(const IMidiMsg& msg)
 {
@@ -165,80 +304,361 @@ void CelestialSynth::OnMidiMsgUI(const IMidiMsg& msg)
 void CelestialSynth::GetBusName(ERoute direction, int busIdx, int nBuses, WDL_String& str) const
 {
   if (direction == ERoute::kOutput)
-    str.Set("Stereo Out");
+  {
+    if (nBuses == 1)
+      str.Set("Stereo Out");
+    else if (busIdx == 0)
+      str.Set("Main Out");
+    else
+      str.SetFormatted(32, "Aux Out %i", busIdx);
+  }
   else
     str.Set("MIDI In");
 }
 
 void CelestialSynth::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
 {
-  mDSP.ProcessBlock(inputs, outputs, 0, 2, nFrames, 0.0);
+  CELESTIAL_RT_AUDIT_SCOPE();
+
+  mMorph.Process(nFrames, [this](int slot, double value) { ApplyPresetSlot(slot, value); });
+
+  // Every stereo pair is a bus, let the DSP skip the ones the host hasn't connected
+  for (int b = 1; b < CelestialSynthDSP<sample>::kMaxBuses; b++)
+    mDSP.SetBusConnected(b, IsChannelConnected(ERoute::kOutput, 2 * b));
+
+  mDSP.SetRenderingOffline(GetRenderingOffline());
+  mDSP.ProcessBlock(inputs, outputs, 0, MaxNChannels(ERoute::kOutput), nFrames, 0.0);
+
+  // Only copies anything while the editor is open
+  mSpectrumTap.Push(outputs, std::min(2, MaxNChannels(ERoute::kOutput)), nFrames);
+
+  // The DSP measures the main bus as it finishes each block, we only forward a reading every window
+  // Silence is sent once, after that the meter is left alone so it doesn't keep repainting
+  CelestialSynthDSP<sample>::MeterReading meter;
+  if (mDSP.TakeMeterReading(mMeterWindowFrames, meter) && !(mMeterSilent && meter.peak[0] == 0.f && meter.peak[1] == 0.f))
+  {
+    mMeterSilent = meter.peak[0] == 0.f && meter.peak[1] == 0.f;
+
+    ISenderData<2, std::pair<float, float>> data;
+    data.ctrlTag = kCtrlMeter;
+    data.nChans = 2;
+    data.chanOffset = 0;
+    for (int c = 0; c < 2; c++)
+      data.vals[c] = {meter.peak[c], meter.rms[c]};
+    mMeterSender.PushData(data);
+  }
+
+  CelestialLoadReading load;
+  if (mDSP.TakeLoadReading(mLoadWindowFrames, load))
+  {
+    ISenderData<1, CelestialLoadReading> data;
+    data.ctrlTag = kCtrlLoadMeter;
+    data.vals[0] = load;
+    mLoadSender.PushData(data);
+  }
 }
 
 void CelestialSynth::ProcessMidiMsg(const IMidiMsg& msg)
 {
+  CELESTIAL_RT_AUDIT_SCOPE();
   TRACE;
   mDSP.ProcessMidiMsg(msg);
 }
 
 void CelestialSynth::OnReset()
 {
-  mDSP.Reset(GetSampleRate(), GetBlockSize());
+  mDSP.Reset(GetSampleRate(), GetBlockSize(), NOutChansConnected());
+  mMeterWindowFrames = std::max(1, (int)(GetSampleRate() / kMeterUpdateHz));
+  mLoadWindowFrames = std::max(1, (int)(GetSampleRate() / kLoadUpdateHz));
+  mSpectrumTap.SetSampleRate(GetSampleRate());
   
-  // Initialize all parameters to their current values
-  mDSP.SetBrilliance(GetParam(kParamBrilliance)->Value());
-  mDSP.SetMotion(GetParam(kParamMotion)->Value());
-  mDSP.SetSpace(GetParam(kParamSpace)->Value());
-  mDSP.SetWarmth(GetParam(kParamWarmth)->Value());
-  mDSP.SetPurity(GetParam(kParamPurity)->Value());
-  mDSP.SetGravity(GetParam(kParamGravity)->Value());
-  mDSP.SetTimbreShift(GetParam(kParamTimbreShift)->Value());
-  mDSP.SetHarmonicBlend(GetParam(kParamHarmonicBlend)->Value());
-  mDSP.SetVoiceCount(GetParam(kParamVoices)->Int());
-  mDSP.SetGain(GetParam(kParamGain)->Value());
-  mDSP.SetScale(GetParam(kParamScaleType)->Int());
+  // Initialize all parameters to their current values, the preset slots without ramping
+  for (int s = 0; s < kNumPresetSlots; s++)
+    mMorph.SetSource(s, GetParam(kPresetSlotParams[s])->Value());
+  mMorph.SetMorphTarget(GetParam(kParamMorphTarget)->Int());
+  mMorph.SetMorphAmount(GetParam(kParamMorphAmount)->Value());
+  mMorph.Reset(GetSampleRate(), [this](int slot, double value) { ApplyPresetSlot(slot, value); });
+
   mDSP.SetMPEEnabled(GetParam(kParamMPEEnable)->Bool());
+  mDSP.SetRouting(GetParam(kParamOutputRouting)->Int());
+  mDSP.SetConvolutionMix(GetParam(kParamConvolutionMix)->Value());
+
+  // Let the host know how long we keep ringing after the last note
+  SetTailSize(mDSP.GetTailSamples());
 }
 
 void CelestialSynth::OnParamChange(int paramIdx)
 {
+  // Sound parameters reach the DSP through the morpher, which ramps them on the audio thread
+  const int slot = GetPresetSlot(paramIdx);
+  if (slot >= 0)
+  {
+    mMorph.SetSource(slot, GetParam(paramIdx)->Value());
+    return;
+  }
+
   switch (paramIdx)
   {
-    case kParamBrilliance:
-      mDSP.SetBrilliance(GetParam(paramIdx)->Value());
+    case kParamMPEEnable:
+      mDSP.SetMPEEnabled(GetParam(paramIdx)->Bool());
       break;
-    case kParamMotion:
-      mDSP.SetMotion(GetParam(paramIdx)->Value());
+    case kParamOutputRouting:
+      mDSP.SetRouting(GetParam(paramIdx)->Int());
       break;
-    case kParamSpace:
-      mDSP.SetSpace(GetParam(paramIdx)->Value());
+    case kParamMorphTarget:
+      mMorph.SetMorphTarget(GetParam(paramIdx)->Int());
       break;
-    case kParamWarmth:
-      mDSP.SetWarmth(GetParam(paramIdx)->Value());
+    case kParamMorphAmount:
+      mMorph.SetMorphAmount(GetParam(paramIdx)->Value());
       break;
-    case kParamPurity:
-      mDSP.SetPurity(GetParam(paramIdx)->Value());
+    case kParamConvolutionMix:
+      mDSP.SetConvolutionMix(GetParam(paramIdx)->Value());
       break;
-    case kParamGravity:
-      mDSP.SetGravity(GetParam(paramIdx)->Value());
+    default:
       break;
-    case kParamTimbreShift:
-      mDSP.SetTimbreShift(GetParam(paramIdx)->Value());
+  }
+}
+
+void CelestialSynth::OnParamReset(EParamSource source)
+{
+  // A program change crossfades into the new preset instead of jumping. Voices keep playing.
+  const bool recall = source == kPresetRecall;
+  if (recall)
+    mMorph.BeginRecall();
+
+  Plugin::OnParamReset(source);
+
+  if (recall)
+    mMorph.EndRecall();
+}
+
+// State chunk layout, values as written by IByteChunk:
+//   int32 magic 'CLST', int32 version, int32 section count
+//   then per section: int32 tag, int32 payload size, payload. Tags a reader doesn't know are skipped.
+//   'PRMS' int32 count, count x double      plain parameter values in EParams order
+//   'TUNE' int32 enabled, 5 x double        custom scale ratios
+//   'SPLT' int32 count, count x int32       note range split points
+//   'IRRF' uint64 hash, string path         impulse response by reference, reloaded from disk
+// Chunks without the magic predate the format and are plain iPlug parameter blocks.
+static constexpr int32_t MakeStateTag(char a, char b, char c, char d)
+{
+  return (int32_t)((uint32_t)a << 24 | (uint32_t)b << 16 | (uint32_t)c << 8 | (uint32_t)d);
+}
+
+static constexpr int32_t kStateMagic = MakeStateTag('C', 'L', 'S', 'T');
+static constexpr int32_t kStateVersion = 1;
+static constexpr int32_t kStateTagParams = MakeStateTag('P', 'R', 'M', 'S');
+static constexpr int32_t kStateTagTuning = MakeStateTag('T', 'U', 'N', 'E');
+static constexpr int32_t kStateTagSplits = MakeStateTag('S', 'P', 'L', 'T');
+static constexpr int32_t kStateTagImpulse = MakeStateTag('I', 'R', 'R', 'F');
+
+// Writes a section header with a placeholder size, returns where the payload starts
+static int BeginStateSection(IByteChunk& chunk, int32_t tag)
+{
+  const int32_t size = 0;
+  chunk.Put(&tag);
+  return chunk.Put(&size);
+}
+
+static void EndStateSection(IByteChunk& chunk, int payloadStart)
+{
+  const int32_t size = chunk.Size() - payloadStart;
+  memcpy(chunk.GetData() + payloadStart - sizeof(int32_t), &size, sizeof(size));
+}
+
+bool CelestialSynth::SerializeState(IByteChunk& chunk) const
+{
+  WriteStateChunk(chunk, true);
+  return true;
+}
+
+void CelestialSynth::WriteStateChunk(IByteChunk& chunk, bool includeSession) const
+{
+  const int32_t header[3] = {kStateMagic, kStateVersion, includeSession ? 4 : 1};
+  chunk.PutBytes(header, sizeof(header));
+
+  int section = BeginStateSection(chunk, kStateTagParams);
+  const int32_t nParams = NParams();
+  chunk.Put(&nParams);
+  for (int i = 0; i < nParams; i++)
+  {
+    const double value = GetParam(i)->Value();
+    chunk.Put(&value);
+  }
+  EndStateSection(chunk, section);
+
+  if (!includeSession)
+    return;
+
+  section = BeginStateSection(chunk, kStateTagTuning);
+  double ratios[PentatonicScaleSystem::kNumDegrees];
+  const int32_t customTuning = mDSP.GetCustomTuning(ratios) ? 1 : 0;
+  chunk.Put(&customTuning);
+  chunk.PutBytes(ratios, sizeof(ratios));
+  EndStateSection(chunk, section);
+
+  section = BeginStateSection(chunk, kStateTagSplits);
+  const int32_t nSplits = CelestialSynthDSP<sample>::kMaxBuses - 1;
+  chunk.Put(&nSplits);
+  for (int i = 0; i < nSplits; i++)
+  {
+    const int32_t split = mDSP.GetNoteSplit(i);
+    chunk.Put(&split);
+  }
+  EndStateSection(chunk, section);
+
+  // Only the IR's identity goes in the chunk, so sessions stay small however long the IR is
+  section = BeginStateSection(chunk, kStateTagImpulse);
+  std::string irPath;
+  const uint64_t irHash = mDSP.GetImpulseResponseId(irPath);
+  chunk.Put(&irHash);
+  chunk.PutStr(irPath.c_str());
+  EndStateSection(chunk, section);
+}
+
+int CelestialSynth::UnserializeState(const IByteChunk& chunk, int startPos)
+{
+  int32_t header[3] = {};
+  int pos = chunk.GetBytes(header, sizeof(header), startPos);
+  if (pos < 0 || header[0] != kStateMagic)
+    return UnserializeParams(chunk, startPos);
+
+  bool hasImpulse = false;
+  uint64_t irHash = 0;
+  WDL_String irPath;
+
+  // Non-parameter state goes to the DSP as one change, so the audio thread never sees half of it
+  ENTER_PARAMS_MUTEX
+  mDSP.BeginStateChange();
+
+  for (int s = 0; s < header[2] && pos >= 0; s++)
+  {
+    int32_t tag = 0, size = 0;
+    pos = chunk.Get(&tag, pos);
+    if (pos >= 0)
+      pos = chunk.Get(&size, pos);
+    if (pos < 0 || size < 0 || pos + size > chunk.Size())
+    {
+      pos = -1;
       break;
-    case kParamHarmonicBlend:
-      mDSP.SetHarmonicBlend(GetParam(paramIdx)->Value());
+    }
+
+    const int sectionEnd = pos + size;
+
+    if (tag == kStateTagParams)
+    {
+      int32_t nParams = 0;
+      int p = chunk.Get(&nParams, pos);
+      for (int i = 0; i < nParams && p >= 0; i++)
+      {
+        double value = 0.0;
+        p = chunk.Get(&value, p);
+        if (p >= 0 && i < NParams())
+          GetParam(i)->Set(value);
+      }
+    }
+    else if (tag == kStateTagTuning)
+    {
+      int32_t customTuning = 0;
+      double ratios[PentatonicScaleSystem::kNumDegrees];
+      int p = chunk.Get(&customTuning, pos);
+      if (p >= 0)
+        p = chunk.GetBytes(ratios, sizeof(ratios), p);
+      if (p >= 0)
+        mDSP.SetCustomTuning(customTuning ? ratios : nullptr);
+    }
+    else if (tag == kStateTagSplits)
+    {
+      int32_t nSplits = 0;
+      int p = chunk.Get(&nSplits, pos);
+      for (int i = 0; i < nSplits && p >= 0; i++)
+      {
+        int32_t split = 0;
+        p = chunk.Get(&split, p);
+        if (p >= 0)
+          mDSP.SetNoteSplit(i, split);
+      }
+    }
+    else if (tag == kStateTagImpulse)
+    {
+      int p = chunk.Get(&irHash, pos);
+      if (p >= 0)
+        p = chunk.GetStr(irPath, p);
+      hasImpulse = p >= 0;
+    }
+
+    pos = sectionEnd;
+  }
+
+  mDSP.EndStateChange();
+
+  // Push the parameters through the morpher as one recall
+  OnParamReset(kPresetRecall);
+  LEAVE_PARAMS_MUTEX
+
+  // The IR is read and transformed on the convolution loader thread, so a restore doesn't wait
+  // for it, and the engine swaps in on the audio thread once it's built. Reloading a project
+  // usually hands back the IR we already have (or are loading), so that costs nothing.
+  std::string currentPath;
+  if (hasImpulse && irHash != mDSP.GetImpulseResponseId(currentPath))
+  {
+    if (irHash)
+      mDSP.LoadImpulseResponseAsync(irPath.Get(), irHash);
+    else
+      mDSP.ClearImpulseResponse();
+  }
+
+  return pos;
+}
+
+void CelestialSynth::ApplyPresetSlot(int slot, double value)
+{
+  switch (slot)
+  {
+    case kSlotBrilliance:
+      mDSP.SetBrilliance(value);
       break;
-    case kParamVoices:
-      mDSP.SetVoiceCount(GetParam(paramIdx)->Int());
+    case kSlotMotion:
+      mDSP.SetMotion(value);
       break;
-    case kParamGain:
-      mDSP.SetGain(GetParam(paramIdx)->Value());
+    case kSlotSpace:
+      mDSP.SetSpace(value);
       break;
-    case kParamScaleType:
-      mDSP.SetScale(GetParam(paramIdx)->Int());
+    case kSlotWarmth:
+      mDSP.SetWarmth(value);
       break;
-    case kParamMPEEnable:
-      mDSP.SetMPEEnabled(GetParam(paramIdx)->Bool());
+    case kSlotPurity:
+      mDSP.SetPurity(value);
+      break;
+    case kSlotGravity:
+      mDSP.SetGravity(value);
+      break;
+    case kSlotTimbreShift:
+      mDSP.SetTimbreShift(value);
+      break;
+    case kSlotHarmonicBlend:
+      mDSP.SetHarmonicBlend(value);
+      break;
+    case kSlotGain:
+      mDSP.SetGain(value);
+      break;
+    case kSlotUnisonDetune:
+      mDSP.SetUnisonDetune(value);
+      break;
+    case kSlotUnisonWidth:
+      mDSP.SetUnisonWidth(value);
+      break;
+    case kSlotVoices:
+      mDSP.SetVoiceCount((int)value);
+      break;
+    case kSlotScaleType:
+      mDSP.SetScale((int)value);
+      break;
+    case kSlotUnisonVoices:
+      mDSP.SetUnisonVoices((int)value);
+      break;
+    case kSlotGlideMode:
+      mDSP.SetGlideMode((int)value);
       break;
     default:
       break;
@@ -255,9 +675,53 @@ bool CelestialSynth::GetMidiNoteText(int noteNumber, char* text) const
   return true;
 }
 
+void CelestialSynth::OnUIOpen()
+{
+  // The spectrum tap and voice snapshot only run while there is a view to feed
+  mSpectrumTap.SetEnabled(true);
+  mDSP.SetVoiceSnapshotEnabled(true);
+#if IPLUG_EDITOR
+  // A fresh view starts out saying "NO IR", OnIdle corrects it if there is one
+  mShownImpulsePath.clear();
+#endif
+  Plugin::OnUIOpen();
+}
+
+void CelestialSynth::OnUIClose()
+{
+  mSpectrumTap.SetEnabled(false);
+  mDSP.SetVoiceSnapshotEnabled(false);
+  Plugin::OnUIClose();
+}
+
 void CelestialSynth::OnIdle()
 {
   mMeterSender.TransmitData(*this);
+  mLoadSender.TransmitData(*this);
+
+  // Space reaches the DSP through a ramp, so pick up the new tail length once it has moved.
+  // The audio thread publishes it, reading the effect state from here would race with it.
+  const int tailSamples = mDSP.GetPublishedTailSamples();
+  if (tailSamples != GetTailSize())
+    SetTailSize(tailSamples);
+
+#if IPLUG_EDITOR
+  // The IR changes from the file chooser, a session restore or a load that failed, so the label
+  // just follows whatever the DSP is set to
+  if (IGraphics* pGraphics = GetUI())
+  {
+    std::string irPath;
+    mDSP.GetImpulseResponseId(irPath);
+    if (irPath != mShownImpulsePath)
+    {
+      mShownImpulsePath = irPath;
+      const size_t slash = irPath.find_last_of("/\\");
+      const std::string name = irPath.empty() ? "NO IR" : irPath.substr(slash == std::string::npos ? 0 : slash + 1);
+      if (IControl* pLabel = pGraphics->GetControlWithTag(kCtrlImpulseName))
+        pLabel->As<ITextControl>()->SetStr(name.c_str());
+    }
+  }
+#endif
 }
 #endif
 
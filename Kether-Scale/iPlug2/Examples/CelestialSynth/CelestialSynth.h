@@ -2,9 +2,13 @@
 
 #include "IPlug_include_in_plug_hdr.h"
 #include "CelestialSynth_DSP.h"
+#include "CelestialSynth_Presets.h"
+#include "CelestialSynth_Spectrum.h"
 #include "ISender.h"
 
 const int kNumPresets = 12;
+const double kMeterUpdateHz = 30.0; // meter readings sent to the UI per second
+const double kLoadUpdateHz = 4.0; // DSP load readings per second, slow enough to read the numbers
 
 // Five Sacred Controls + Additional Parameters
 enum EParams
@@ -26,6 +30,21 @@ enum EParams
   // Global Controls
   kParamGain,
   kParamMPEEnable,
+  kParamOutputRouting,
+
+  // Unison
+  kParamUnisonVoices,
+  kParamUnisonDetune,
+  kParamUnisonWidth,
+
+  kParamGlideMode,
+
+  // Preset morph
+  kParamMorphTarget,
+  kParamMorphAmount,
+
+  // Convolution, the IR itself is chosen from the editor and saved with the session
+  kParamConvolutionMix,
   
   kNumParams
 };
@@ -63,10 +82,13 @@ enum ECtrlTags
   kCtrlScaleType,
   kCtrlGain,
   kCtrlMPE,
+  kCtrlImpulseName,
   
   // Visual Elements
   kCtrlMeter,
   kCtrlConstellation,
+  kCtrlSpectrum,
+  kCtrlLoadMeter,
   
   kNumCtrlTags
 };
@@ -77,6 +99,9 @@ class CelestialSynth final : public Plugin
 {
 public:
   CelestialSynth(const InstanceInfo& info);
+#if CELESTIAL_TRACE
+  ~CelestialSynth();
+#endif
 
 #if IPLUG_EDITOR
   void OnMidiMsgUI(const IMidiMsg& msg) override;
@@ -90,11 +115,28 @@ public:
   void ProcessMidiMsg(const IMidiMsg& msg) override;
   void OnReset() override;
   void OnParamChange(int paramIdx) override;
+  void OnParamReset(EParamSource source) override;
+  bool SerializeState(IByteChunk& chunk) const override;
+  int UnserializeState(const IByteChunk& chunk, int startPos) override;
   bool GetMidiNoteText(int noteNumber, char* text) const override;
   void OnIdle() override;
+  void OnUIOpen() override;
+  void OnUIClose() override;
 
 private:
-  CelestialSynthDSP mDSP;
-  IPeakSender<2> mMeterSender;
+  void ApplyPresetSlot(int slot, double value);
+  void WriteStateChunk(IByteChunk& chunk, bool includeSession) const;
+
+  CelestialSynthDSP<sample> mDSP;
+  PresetMorpher mMorph;
+  IPeakAvgSender<2> mMeterSender;
+  int mMeterWindowFrames = 1024;
+  bool mMeterSilent = false;
+  ISender<1, 8, CelestialLoadReading> mLoadSender;
+  int mLoadWindowFrames = 11025;
+  SpectrumTap mSpectrumTap;
+#if IPLUG_EDITOR
+  std::string mShownImpulsePath; // what the IR label says, OnIdle refreshes it when the DSP's IR changes
+#endif
 #endif
 };
\ No newline at end of file
@@ -0,0 +1,359 @@
+#pragma once
+
+#include "CelestialSynth_DSP.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+// Offline render benchmark for the DSP core. Not part of the plugin build - include it from a
+// scratch app or test host to compare processing types on the target machine.
+
+struct CelestialBenchmarkResult
+{
+  double renderMs = 0.0;     // wall clock time for the whole render
+  double realtimeRatio = 0.0; // seconds of audio rendered per second of CPU
+  double peak = 0.0;          // output peak, to check both runs did the same work
+  CelestialLoadReading load;  // the DSP's own per-stage timing over the whole render
+};
+
+// Renders a held six note chord, then its release tail, through the full chain in blocks of blockSize
+template <typename T>
+CelestialBenchmarkResult BenchmarkCelestialDSP(double sampleRate = 48000.0, int blockSize = 64, double seconds = 10.0)
+{
+  auto dsp = std::make_unique<CelestialSynthDSP<T>>();
+  dsp->Reset(sampleRate, blockSize);
+  dsp->SetVoiceCount(8);
+  dsp->SetWaveform((int)WaveformType::kSaw);
+
+  std::vector<T> left(blockSize), right(blockSize);
+  T* outputs[2] = {left.data(), right.data()};
+
+  static const int kChord[] = {48, 55, 60, 64, 67, 72};
+  for (int note : kChord)
+  {
+    IMidiMsg msg;
+    msg.MakeNoteOnMsg(note, 100, 0);
+    dsp->ProcessMidiMsg(msg);
+  }
+
+  const int totalBlocks = (int)(seconds * sampleRate / blockSize);
+  const int releaseBlock = totalBlocks / 2;
+  CelestialBenchmarkResult result;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  for (int b = 0; b < totalBlocks; b++)
+  {
+    if (b == releaseBlock)
+    {
+      for (int note : kChord)
+      {
+        IMidiMsg msg;
+        msg.MakeNoteOffMsg(note, 0);
+        dsp->ProcessMidiMsg(msg);
+      }
+    }
+
+    dsp->ProcessBlock(nullptr, outputs, 0, 2, blockSize);
+
+    for (int s = 0; s < blockSize; s++)
+      result.peak = std::max(result.peak, (double)std::fabs(left[s]));
+  }
+
+  const auto end = std::chrono::steady_clock::now();
+  dsp->TakeLoadReading(1, result.load);
+  result.renderMs = std::chrono::duration<double, std::milli>(end - start).count();
+  result.realtimeRatio = result.renderMs > 0.0 ? (totalBlocks * blockSize / sampleRate) / (result.renderMs * 0.001) : 0.0;
+  return result;
+}
+
+// Runs both instantiations with the same settings, single precision first
+inline void BenchmarkCelestialPrecision(CelestialBenchmarkResult& singleResult, CelestialBenchmarkResult& doubleResult, double sampleRate = 48000.0, int blockSize = 64, double seconds = 10.0)
+{
+  singleResult = BenchmarkCelestialDSP<float>(sampleRate, blockSize, seconds);
+  doubleResult = BenchmarkCelestialDSP<double>(sampleRate, blockSize, seconds);
+}
+
+// Many instances at once, the way a large session runs them. Each instance has its own buffers,
+// settings and MIDI, and the instances are shared out over host-like render threads that each
+// process a block of all their instances in turn. Shows what the single-instance run hides:
+// per-instance memory and the cache traffic of the delay lines, reverbs and voices of a whole session.
+
+struct CelestialSessionResult
+{
+  int instances = 0;
+  int threads = 0;
+  double renderMs = 0.0;             // wall clock for the whole render
+  double realtimeRatio = 0.0;        // seconds of session rendered per second of wall clock, >= 1 keeps up
+  double instanceBlocksPerSecond = 0.0;
+  size_t instanceBytes = 0;          // sizeof one CelestialSynthDSP, without what it allocates
+  double residentBytesPerInstance = 0.0; // growth of the resident set per instance, Linux only
+  double deadlineMs = 0.0;           // one block of audio
+  double worstCycleMs = 0.0;         // longest one thread took to render a block of all its instances
+  double worstCycleLoad = 0.0;       // worstCycleMs / deadlineMs, over 1 is a dropout on that thread
+
+  // Summed over the render threads from the CPU's generic cache events, -1 where perf events aren't
+  // available (not Linux, or perf_event_paranoid too strict). L2 has no portable event, so this is
+  // the L1 data cache and the last level cache.
+  int64_t l1dAccesses = -1, l1dMisses = -1;
+  int64_t llcAccesses = -1, llcMisses = -1;
+};
+
+namespace CelestialSessionBenchmark
+{
+// Resident set in bytes, 0 where it can't be read
+inline double GetResidentBytes()
+{
+#if defined(__linux__)
+  long pages = 0, resident = 0;
+  FILE* fp = fopen("/proc/self/statm", "r");
+  if (!fp)
+    return 0.0;
+  const bool ok = fscanf(fp, "%ld %ld", &pages, &resident) == 2;
+  fclose(fp);
+  return ok ? (double)resident * sysconf(_SC_PAGESIZE) : 0.0;
+#else
+  return 0.0;
+#endif
+}
+
+// Cache counters for the calling thread
+class CacheCounters
+{
+public:
+  enum ECounter { kL1DAccess = 0, kL1DMiss, kLLCAccess, kLLCMiss, kNumCounters };
+
+  CacheCounters()
+  {
+#if defined(__linux__)
+    const uint64_t kConfigs[kNumCounters] = {
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16),
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16),
+      PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+
+    for (int c = 0; c < kNumCounters; c++)
+    {
+      perf_event_attr attr = {};
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.size = sizeof(attr);
+      attr.config = kConfigs[c];
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      mFds[c] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+      if (mFds[c] >= 0)
+        ioctl(mFds[c], PERF_EVENT_IOC_RESET, 0);
+    }
+#endif
+  }
+
+  ~CacheCounters()
+  {
+#if defined(__linux__)
+    for (int fd : mFds)
+    {
+      if (fd >= 0)
+        close(fd);
+    }
+#endif
+  }
+
+  void Start()
+  {
+#if defined(__linux__)
+    for (int fd : mFds)
+    {
+      if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  void Stop()
+  {
+#if defined(__linux__)
+    for (int fd : mFds)
+    {
+      if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+#endif
+  }
+
+  // -1 if the counter couldn't be opened
+  int64_t Read(int counter) const
+  {
+#if defined(__linux__)
+    int64_t value = 0;
+    if (mFds[counter] >= 0 && read(mFds[counter], &value, sizeof(value)) == sizeof(value))
+      return value;
+#endif
+    return -1;
+  }
+
+private:
+  int mFds[kNumCounters] = {-1, -1, -1, -1};
+};
+
+template <typename T>
+struct Instance
+{
+  std::unique_ptr<CelestialSynthDSP<T>> dsp;
+  std::vector<T> left, right;
+  uint32_t rng = 1;
+  int nextPhraseBlock = 0;
+  int releaseBlock = -1;
+  int notes[5] = {};
+  int numNotes = 0;
+
+  uint32_t Next()
+  {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+  }
+
+  // Phrases of three to five note chords, a quarter to one second apart, held for most of that
+  void SendMidi(int block, int blocksPerSecond)
+  {
+    if (block == releaseBlock)
+    {
+      for (int n = 0; n < numNotes; n++)
+      {
+        IMidiMsg msg;
+        msg.MakeNoteOffMsg(notes[n], 0);
+        dsp->ProcessMidiMsg(msg);
+      }
+      numNotes = 0;
+    }
+
+    if (block != nextPhraseBlock)
+      return;
+
+    const int length = blocksPerSecond / 4 + (int)(Next() % (uint32_t)(3 * blocksPerSecond / 4 + 1));
+    nextPhraseBlock = block + length;
+    releaseBlock = block + length * 3 / 4;
+
+    const int root = 36 + (int)(Next() % 36);
+    numNotes = 3 + (int)(Next() % 3);
+    for (int n = 0; n < numNotes; n++)
+    {
+      notes[n] = root + (int)(Next() % 24);
+      IMidiMsg msg;
+      msg.MakeNoteOnMsg(notes[n], 40 + (int)(Next() % 88), 0);
+      dsp->ProcessMidiMsg(msg);
+    }
+  }
+};
+} // namespace CelestialSessionBenchmark
+
+// Renders numInstances instances for the given length of audio on numThreads threads, instance i on
+// thread i % numThreads. The threads run flat out rather than waiting for a period, so the result
+// is throughput; the worst cycle against the deadline says whether a real host would have kept up.
+template <typename T>
+CelestialSessionResult BenchmarkCelestialSession(int numInstances = 100, int numThreads = 4, double seconds = 5.0, double sampleRate = 48000.0, int blockSize = 128)
+{
+  using namespace CelestialSessionBenchmark;
+
+  CelestialSessionResult result;
+  result.instances = numInstances = std::max(1, numInstances);
+  result.threads = numThreads = std::max(1, std::min(numThreads, numInstances));
+  result.instanceBytes = sizeof(CelestialSynthDSP<T>);
+  result.deadlineMs = 1000.0 * blockSize / sampleRate;
+
+  const double residentBefore = GetResidentBytes();
+
+  // Spread the settings across the session, every instance sounds a little different
+  std::vector<Instance<T>> instances(numInstances);
+  for (int i = 0; i < numInstances; i++)
+  {
+    Instance<T>& instance = instances[i];
+    instance.dsp = std::make_unique<CelestialSynthDSP<T>>();
+    instance.dsp->Reset(sampleRate, blockSize);
+    instance.dsp->SetScale(i % PentatonicScaleSystem::kNumScales);
+    instance.dsp->SetWaveform(i % (int)WaveformType::kNumWaveforms);
+    instance.dsp->SetVoiceCount(4 + i % 13);
+    instance.dsp->SetSpace((i % 10) / 9.0);
+    instance.dsp->SetMotion((i % 7) / 6.0);
+    instance.dsp->SetDelayMix(i % 3 ? 0.2 : 0.0);
+    instance.left.assign(blockSize, T(0));
+    instance.right.assign(blockSize, T(0));
+    instance.rng = 0x9E3779B9u * (uint32_t)(i + 1);
+    instance.nextPhraseBlock = (int)(instance.Next() % (uint32_t)std::max(1.0, sampleRate / blockSize));
+  }
+
+  const int totalBlocks = (int)(seconds * sampleRate / blockSize);
+  const int blocksPerSecond = std::max(1, (int)(sampleRate / blockSize));
+  std::vector<double> worstCycleMs(numThreads, 0.0);
+  std::vector<int64_t> counts(numThreads * CacheCounters::kNumCounters, -1);
+
+  auto renderThread = [&](int t) {
+    CacheCounters counters;
+    counters.Start();
+
+    for (int b = 0; b < totalBlocks; b++)
+    {
+      const auto cycleStart = std::chrono::steady_clock::now();
+
+      for (int i = t; i < numInstances; i += numThreads)
+      {
+        Instance<T>& instance = instances[i];
+        instance.SendMidi(b, blocksPerSecond);
+        T* outputs[2] = {instance.left.data(), instance.right.data()};
+        instance.dsp->ProcessBlock(nullptr, outputs, 0, 2, blockSize);
+      }
+
+      const double cycleMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cycleStart).count();
+      worstCycleMs[t] = std::max(worstCycleMs[t], cycleMs);
+    }
+
+    counters.Stop();
+    for (int c = 0; c < CacheCounters::kNumCounters; c++)
+      counts[t * CacheCounters::kNumCounters + c] = counters.Read(c);
+  };
+
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> threads;
+  for (int t = 1; t < numThreads; t++)
+    threads.emplace_back(renderThread, t);
+  renderThread(0);
+  for (std::thread& thread : threads)
+    thread.join();
+
+  const auto end = std::chrono::steady_clock::now();
+
+  result.renderMs = std::chrono::duration<double, std::milli>(end - start).count();
+  result.realtimeRatio = result.renderMs > 0.0 ? (totalBlocks * blockSize / sampleRate) / (result.renderMs * 0.001) : 0.0;
+  result.instanceBlocksPerSecond = result.renderMs > 0.0 ? (double)totalBlocks * numInstances / (result.renderMs * 0.001) : 0.0;
+  result.residentBytesPerInstance = residentBefore > 0.0 ? (GetResidentBytes() - residentBefore) / numInstances : 0.0;
+  result.worstCycleMs = *std::max_element(worstCycleMs.begin(), worstCycleMs.end());
+  result.worstCycleLoad = result.worstCycleMs / result.deadlineMs;
+
+  int64_t* totals[CacheCounters::kNumCounters] = {&result.l1dAccesses, &result.l1dMisses, &result.llcAccesses, &result.llcMisses};
+  for (int c = 0; c < CacheCounters::kNumCounters; c++)
+  {
+    int64_t sum = 0;
+    for (int t = 0; t < numThreads && sum >= 0; t++)
+    {
+      const int64_t count = counts[t * CacheCounters::kNumCounters + c];
+      sum = count >= 0 ? sum + count : -1;
+    }
+    *totals[c] = sum;
+  }
+
+  return result;
+}
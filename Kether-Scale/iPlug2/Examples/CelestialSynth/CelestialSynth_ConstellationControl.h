@@ -0,0 +1,103 @@
+#pragma once
+
+#include "IControl.h"
+#include "CelestialSynth_VoiceSnapshot.h"
+#include <functional>
+
+using namespace iplug;
+using namespace igraphics;
+
+// The sounding voices as stars: pan across, pitch up, brightness from the envelope, coloured by
+// scale degree and joined in pitch order. Reads the DSP's voice snapshot once per frame.
+class CelestialConstellationControl : public IControl
+{
+public:
+  static constexpr int kLowestNote = 24;
+  static constexpr int kHighestNote = 108;
+
+  // Copies the newest snapshot into its argument, false if nothing changed
+  using SnapshotFunc = std::function<bool(CelestialVoiceSnapshot&)>;
+
+  CelestialConstellationControl(const IRECT& bounds, SnapshotFunc snapshotFunc, const IColor& lineColor)
+  : IControl(bounds)
+  , mSnapshotFunc(std::move(snapshotFunc))
+  , mLineColor(lineColor)
+  {
+    mIgnoreMouse = true;
+  }
+
+  // The DSP only publishes when something changed, so an idle synth doesn't keep the view redrawing
+  bool IsDirty() override
+  {
+    return (mSnapshotFunc && mSnapshotFunc(mSnapshot)) || IControl::IsDirty();
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    g.FillRect(COLOR_BLACK.WithOpacity(0.35f), mRECT);
+
+    // Pitch order, so the lines trace the chord from the bottom up
+    int order[CelestialVoiceSnapshot::kMaxVoices];
+    const int n = mSnapshot.numVoices;
+    for (int i = 0; i < n; i++)
+    {
+      int j = i;
+      while (j > 0 && mSnapshot.voices[order[j - 1]].note > mSnapshot.voices[i].note)
+      {
+        order[j] = order[j - 1];
+        j--;
+      }
+      order[j] = i;
+    }
+
+    float prevX = 0.f, prevY = 0.f;
+    for (int i = 0; i < n; i++)
+    {
+      const CelestialVoiceState& voice = mSnapshot.voices[order[i]];
+      const float x = GetX(voice.pan);
+      const float y = GetY(voice.note);
+      if (i > 0)
+        g.DrawLine(mLineColor, prevX, prevY, x, y);
+      prevX = x;
+      prevY = y;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+      const CelestialVoiceState& voice = mSnapshot.voices[i];
+      const float level = std::clamp(voice.level, 0.f, 1.f);
+      const IColor& color = kDegreeColors[std::clamp(voice.degree, 0, 4)];
+      const float x = GetX(voice.pan);
+      const float y = GetY(voice.note);
+
+      g.FillCircle(color.WithOpacity(0.25f * level), x, y, 4.f + 10.f * level);
+      g.FillCircle(color.WithOpacity(0.4f + 0.6f * level), x, y, 1.5f + 2.5f * level);
+    }
+  }
+
+private:
+  float GetX(float pan) const
+  {
+    const float inset = 12.f;
+    return mRECT.MW() + std::clamp(pan, -1.f, 1.f) * (mRECT.W() * 0.5f - inset);
+  }
+
+  float GetY(int note) const
+  {
+    const float inset = 8.f;
+    const float norm = std::clamp((float)(note - kLowestNote) / (kHighestNote - kLowestNote), 0.f, 1.f);
+    return mRECT.B - inset - norm * (mRECT.H() - 2.f * inset);
+  }
+
+  const IColor kDegreeColors[5] = {
+    IColor(255, 255, 215, 138), // gold
+    IColor(255, 220, 220, 220), // silver
+    IColor(255, 100, 150, 255), // blue
+    IColor(255, 255, 140, 80),  // amber
+    IColor(255, 180, 100, 255)  // violet
+  };
+
+  SnapshotFunc mSnapshotFunc;
+  CelestialVoiceSnapshot mSnapshot;
+  IColor mLineColor;
+};
@@ -0,0 +1,1169 @@
+#pragma once
+
+#include "IPlugPlatform.h"
+#include "CelestialSynth_Denormals.h"
+#include "CelestialSynth_Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace iplug;
+
+// Radix-2 complex FFT on split real/imaginary arrays, single precision
+class ConvolutionFFT
+{
+public:
+  void Init(int size)
+  {
+    mSize = size;
+    mBitRev.resize(size);
+    mCos.resize(size / 2);
+    mSin.resize(size / 2);
+
+    int bits = 0;
+    while ((1 << bits) < size)
+      bits++;
+
+    for (int i = 0; i < size; i++)
+    {
+      int r = 0;
+      for (int b = 0; b < bits; b++)
+        r |= ((i >> b) & 1) << (bits - 1 - b);
+      mBitRev[i] = r;
+    }
+
+    for (int k = 0; k < size / 2; k++)
+    {
+      mCos[k] = (float)std::cos(2.0 * 3.14159265358979 * k / size);
+      mSin[k] = (float)std::sin(2.0 * 3.14159265358979 * k / size);
+    }
+  }
+
+  int GetSize() const { return mSize; }
+
+  // In place, unscaled in both directions
+  void Transform(float* re, float* im, bool inverse) const
+  {
+    const int n = mSize;
+    const float sign = inverse ? 1.f : -1.f;
+
+    for (int i = 0; i < n; i++)
+    {
+      const int j = mBitRev[i];
+      if (j > i)
+      {
+        std::swap(re[i], re[j]);
+        std::swap(im[i], im[j]);
+      }
+    }
+
+    for (int len = 2; len <= n; len <<= 1)
+    {
+      const int half = len >> 1;
+      const int step = n / len;
+      for (int i = 0; i < n; i += len)
+      {
+        for (int j = 0; j < half; j++)
+        {
+          const float wr = mCos[j * step];
+          const float wi = sign * mSin[j * step];
+          const int a = i + j;
+          const int b = a + half;
+          const float tr = re[b] * wr - im[b] * wi;
+          const float ti = re[b] * wi + im[b] * wr;
+          re[b] = re[a] - tr;
+          im[b] = im[a] - ti;
+          re[a] += tr;
+          im[a] += ti;
+        }
+      }
+    }
+  }
+
+private:
+  int mSize = 0;
+  std::vector<int> mBitRev;
+  std::vector<float> mCos;
+  std::vector<float> mSin;
+};
+
+// Raw impulse response as loaded from disk or memory, before any transformation
+struct ImpulseResponse
+{
+  std::vector<float> left;
+  std::vector<float> right;
+  double sampleRate = 44100.0;
+  bool stereo = false;
+  uint64_t hash = 0;
+  std::string path;
+
+  static std::shared_ptr<ImpulseResponse> FromBuffers(const float* left, const float* right, int nSamples, double sampleRate)
+  {
+    if (!left || nSamples <= 0 || sampleRate <= 0.0)
+      return nullptr;
+
+    auto ir = std::make_shared<ImpulseResponse>();
+    ir->left.assign(left, left + nSamples);
+    ir->right.assign(right ? right : left, (right ? right : left) + nSamples);
+    ir->sampleRate = sampleRate;
+    ir->stereo = right && std::memcmp(left, right, nSamples * sizeof(float)) != 0;
+    ir->UpdateHash();
+    return ir;
+  }
+
+  // Reads 16/24-bit PCM or 32-bit float WAV files, keeping the first two channels
+  static std::shared_ptr<ImpulseResponse> FromWavFile(const char* path)
+  {
+    FILE* fp = path ? fopen(path, "rb") : nullptr;
+    if (!fp)
+      return nullptr;
+
+    std::vector<unsigned char> data;
+    unsigned char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+      data.insert(data.end(), chunk, chunk + n);
+    fclose(fp);
+
+    auto rd16 = [&](size_t pos) { return (int)(data[pos] | (data[pos + 1] << 8)); };
+    auto rd32 = [&](size_t pos) { return (uint32_t)(data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16) | ((uint32_t)data[pos + 3] << 24)); };
+
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) || memcmp(data.data() + 8, "WAVE", 4))
+      return nullptr;
+
+    int format = 0, channels = 0, bits = 0;
+    double sampleRate = 0.0;
+    size_t dataPos = 0, dataSize = 0;
+
+    for (size_t pos = 12; pos + 8 <= data.size();)
+    {
+      const uint32_t size = rd32(pos + 4);
+      if (!memcmp(data.data() + pos, "fmt ", 4) && pos + 24 <= data.size())
+      {
+        format = rd16(pos + 8);
+        channels = rd16(pos + 10);
+        sampleRate = (double)rd32(pos + 12);
+        bits = rd16(pos + 22);
+        if (format == 0xFFFE && pos + 34 <= data.size())
+          format = rd16(pos + 32); // WAVE_FORMAT_EXTENSIBLE sub-format
+      }
+      else if (!memcmp(data.data() + pos, "data", 4))
+      {
+        dataPos = pos + 8;
+        dataSize = std::min((size_t)size, data.size() - dataPos);
+      }
+      pos += 8 + size + (size & 1);
+    }
+
+    const bool validFormat = (format == 1 && (bits == 16 || bits == 24)) || (format == 3 && bits == 32);
+    if (!validFormat || channels < 1 || !dataPos || sampleRate <= 0.0)
+      return nullptr;
+
+    const int bytesPerSample = bits / 8;
+    const int nFrames = (int)(dataSize / (bytesPerSample * channels));
+    std::vector<float> buf[2];
+    buf[0].resize(nFrames);
+    buf[1].resize(nFrames);
+
+    for (int f = 0; f < nFrames; f++)
+    {
+      for (int c = 0; c < 2; c++)
+      {
+        const size_t p = dataPos + ((size_t)f * channels + std::min(c, channels - 1)) * bytesPerSample;
+        float v = 0.f;
+        if (bits == 16)
+          v = (int16_t)rd16(p) / 32768.f;
+        else if (bits == 24)
+          v = (float)((int32_t)((data[p] << 8) | (data[p + 1] << 16) | ((uint32_t)data[p + 2] << 24)) >> 8) / 8388608.f;
+        else
+        {
+          const uint32_t u = rd32(p);
+          memcpy(&v, &u, sizeof(float));
+        }
+        buf[c][f] = v;
+      }
+    }
+
+    auto ir = FromBuffers(buf[0].data(), channels > 1 ? buf[1].data() : nullptr, nFrames, sampleRate);
+    if (ir)
+      ir->path = path;
+    return ir;
+  }
+
+  // As FromWavFile, but instances loading the same file while another still holds it share one copy
+  // instead of each reading the disk. With expectedHash set, a cached copy that no longer matches
+  // (the file was edited) is read again.
+  static std::shared_ptr<const ImpulseResponse> FromWavFileShared(const char* path, uint64_t expectedHash = 0)
+  {
+    static std::mutex sCacheMutex;
+    static std::unordered_map<std::string, std::weak_ptr<const ImpulseResponse>> sCache;
+
+    if (!path)
+      return nullptr;
+
+    std::lock_guard<std::mutex> lock(sCacheMutex);
+
+    auto it = sCache.find(path);
+    if (it != sCache.end())
+    {
+      auto existing = it->second.lock();
+      if (existing && (!expectedHash || existing->hash == expectedHash))
+        return existing;
+    }
+
+    for (auto e = sCache.begin(); e != sCache.end();)
+      e = e->second.expired() ? sCache.erase(e) : std::next(e);
+
+    std::shared_ptr<const ImpulseResponse> ir = FromWavFile(path);
+    if (ir)
+      sCache[path] = ir;
+    return ir;
+  }
+
+private:
+  void UpdateHash()
+  {
+    // FNV-1a over the sample data and rate, used to share transformed IRs between instances
+    uint64_t h = 1469598103934665603ULL;
+    auto mix = [&h](const void* p, size_t size) {
+      const unsigned char* b = (const unsigned char*)p;
+      for (size_t i = 0; i < size; i++)
+        h = (h ^ b[i]) * 1099511628211ULL;
+    };
+    mix(left.data(), left.size() * sizeof(float));
+    mix(right.data(), right.size() * sizeof(float));
+    mix(&sampleRate, sizeof(sampleRate));
+    hash = h;
+  }
+};
+
+// Impulse response resampled to the session rate and pre-transformed into partition spectra.
+// Immutable once built, so one copy is shared by every instance that loads the same IR.
+class ConvolutionIR
+{
+public:
+  static constexpr int kHeadSize = 64;
+  static constexpr double kMaxSeconds = 10.0;
+
+  // Partition layout: a direct-form FIR head, then levels of uniform partitions that grow
+  // 64 -> 1024 -> 8192. Each level starts two of its own partitions in, which is the time
+  // budget the worker has to deliver a block.
+  struct Level
+  {
+    int partitionSize = 0;
+    int offset = 0;
+    int numPartitions = 0;
+    std::vector<float> aRe, aIm; // (HL + HR) / 2N
+    std::vector<float> bRe, bIm; // (HL - HR) / 2N, empty for mono IRs
+  };
+
+  // Builds or reuses the transformed IR for this sample rate. Never call on the audio thread.
+  static std::shared_ptr<const ConvolutionIR> Get(const std::shared_ptr<const ImpulseResponse>& source, double sampleRate)
+  {
+    static std::mutex sCacheMutex;
+    static std::unordered_map<uint64_t, std::weak_ptr<const ConvolutionIR>> sCache;
+
+    if (!source)
+      return nullptr;
+
+    uint64_t key = source->hash;
+    uint64_t rateBits;
+    memcpy(&rateBits, &sampleRate, sizeof(rateBits));
+    key ^= rateBits * 0x9E3779B97F4A7C15ULL;
+
+    std::lock_guard<std::mutex> lock(sCacheMutex);
+
+    auto it = sCache.find(key);
+    if (it != sCache.end())
+    {
+      if (auto existing = it->second.lock())
+        return existing;
+    }
+
+    for (auto e = sCache.begin(); e != sCache.end();)
+      e = e->second.expired() ? sCache.erase(e) : std::next(e);
+
+    std::shared_ptr<const ConvolutionIR> ir(new ConvolutionIR(*source, sampleRate));
+    sCache[key] = ir;
+    return ir;
+  }
+
+  int GetLength() const { return mLength; }
+  bool IsStereo() const { return mStereo; }
+
+  // Smallest partition the worker runs. Its deadline is one partition after the input block is complete.
+  static constexpr int GetWorkerPartitionSize() { return kLevelSizes[1]; }
+  // Largest partition, with the longest deadline
+  static constexpr int GetLastPartitionSize() { return kLevelSizes[kNumLevels - 1]; }
+
+  std::vector<float> mHeadL, mHeadR; // time reversed for the direct-form dot product
+  std::vector<Level> mLevels;
+
+private:
+  ConvolutionIR(const ImpulseResponse& source, double sampleRate)
+  {
+    mStereo = source.stereo;
+
+    // Resample to the session rate with linear interpolation
+    const double ratio = source.sampleRate / sampleRate;
+    const int srcLength = (int)source.left.size();
+    mLength = std::min((int)(srcLength / ratio), (int)(kMaxSeconds * sampleRate));
+
+    std::vector<float> h[2];
+    double energy = 0.0;
+    for (int c = 0; c < 2; c++)
+    {
+      const std::vector<float>& src = c ? source.right : source.left;
+      h[c].resize(mLength);
+      for (int i = 0; i < mLength; i++)
+      {
+        const double pos = i * ratio;
+        const int i0 = (int)pos;
+        const int i1 = std::min(i0 + 1, srcLength - 1);
+        const double frac = pos - i0;
+        h[c][i] = (float)(src[i0] + (src[i1] - src[i0]) * frac);
+        energy += h[c][i] * h[c][i];
+      }
+    }
+
+    // Normalise to unit energy per channel so every IR sits at the same level
+    const float norm = energy > 0.0 ? (float)(1.0 / std::sqrt(energy * 0.5)) : 0.f;
+    for (int c = 0; c < 2; c++)
+      for (float& v : h[c])
+        v *= norm;
+
+    mHeadL.assign(kHeadSize, 0.f);
+    mHeadR.assign(kHeadSize, 0.f);
+    for (int i = 0; i < std::min(kHeadSize, mLength); i++)
+    {
+      mHeadL[kHeadSize - 1 - i] = h[0][i];
+      mHeadR[kHeadSize - 1 - i] = h[1][i];
+    }
+
+    for (int l = 0; l < kNumLevels; l++)
+    {
+      const int end = std::min(mLength, kLevelEnds[l]);
+      if (end <= kLevelOffsets[l])
+        break;
+
+      Level level;
+      level.partitionSize = kLevelSizes[l];
+      level.offset = kLevelOffsets[l];
+      level.numPartitions = (end - level.offset + level.partitionSize - 1) / level.partitionSize;
+      TransformLevel(level, h[0], h[1]);
+      mLevels.push_back(std::move(level));
+    }
+  }
+
+  void TransformLevel(Level& level, const std::vector<float>& hL, const std::vector<float>& hR)
+  {
+    const int T = level.partitionSize;
+    const int N = 2 * T;
+    const float scale = 0.5f / N;
+
+    ConvolutionFFT fft;
+    fft.Init(N);
+    std::vector<float> re(N), im(N);
+
+    level.aRe.resize((size_t)level.numPartitions * N);
+    level.aIm.resize((size_t)level.numPartitions * N);
+    if (mStereo)
+    {
+      level.bRe.resize((size_t)level.numPartitions * N);
+      level.bIm.resize((size_t)level.numPartitions * N);
+    }
+
+    for (int p = 0; p < level.numPartitions; p++)
+    {
+      std::fill(re.begin(), re.end(), 0.f);
+      std::fill(im.begin(), im.end(), 0.f);
+      const int start = level.offset + p * T;
+      for (int j = 0; j < T && start + j < mLength; j++)
+      {
+        re[j] = hL[start + j];
+        im[j] = hR[start + j];
+      }
+
+      fft.Transform(re.data(), im.data(), false);
+
+      // Split the packed spectrum into HL and HR, then fold into the A/B form used by
+      // the packed-stereo multiply: Y = A * X + B * conj(X[N-k])
+      float* aRe = level.aRe.data() + (size_t)p * N;
+      float* aIm = level.aIm.data() + (size_t)p * N;
+      for (int k = 0; k < N; k++)
+      {
+        const int kk = (N - k) & (N - 1);
+        const float cRe = re[kk];
+        const float cIm = -im[kk];
+        const float lRe = re[k] + cRe;
+        const float lIm = im[k] + cIm;
+        const float rRe = im[k] - cIm;
+        const float rIm = cRe - re[k];
+        aRe[k] = (lRe + rRe) * 0.5f * scale;
+        aIm[k] = (lIm + rIm) * 0.5f * scale;
+        if (mStereo)
+        {
+          level.bRe[(size_t)p * N + k] = (lRe - rRe) * 0.5f * scale;
+          level.bIm[(size_t)p * N + k] = (lIm - rIm) * 0.5f * scale;
+        }
+      }
+    }
+  }
+
+  static constexpr int kNumLevels = 3;
+  static constexpr int kLevelSizes[kNumLevels] = {64, 1024, 8192};
+  static constexpr int kLevelOffsets[kNumLevels] = {64, 2048, 16384};
+  static constexpr int kLevelEnds[kNumLevels] = {2048, 16384, 0x7FFFFFFF};
+
+  int mLength = 0;
+  bool mStereo = false;
+};
+
+// Per-instance runtime state for one transformed IR: input history, frequency-domain delay
+// lines and output rings. Level 0 runs on the audio thread; the larger levels run on the
+// worker and hand their output back through rings guarded by a published block counter.
+class ConvolutionEngine
+{
+public:
+  explicit ConvolutionEngine(std::shared_ptr<const ConvolutionIR> ir)
+  : mIR(std::move(ir))
+  {
+    if (!mIR)
+      return;
+
+    int maxPartition = ConvolutionIR::kHeadSize;
+    for (const ConvolutionIR::Level& irLevel : mIR->mLevels)
+    {
+      LevelState& level = mLevels[mNumLevels++];
+      level.ir = &irLevel;
+      level.fftSize = 2 * irLevel.partitionSize;
+      level.shift = 0;
+      while ((1 << level.shift) < irLevel.partitionSize)
+        level.shift++;
+      level.fft.Init(level.fftSize);
+      level.fdlRe.assign((size_t)irLevel.numPartitions * level.fftSize, 0.f);
+      level.fdlIm.assign((size_t)irLevel.numPartitions * level.fftSize, 0.f);
+      level.workRe.resize(level.fftSize);
+      level.workIm.resize(level.fftSize);
+      level.accRe.resize(level.fftSize);
+      level.accIm.resize(level.fftSize);
+
+      int ringSize = 1;
+      while (ringSize < irLevel.offset + 2 * irLevel.partitionSize)
+        ringSize <<= 1;
+      level.outL.assign(ringSize, 0.f);
+      level.outR.assign(ringSize, 0.f);
+      level.outMask = ringSize - 1;
+      maxPartition = std::max(maxPartition, irLevel.partitionSize);
+    }
+
+    int inputSize = 1;
+    while (inputSize < 4 * maxPartition)
+      inputSize <<= 1;
+    mInRe.assign(inputSize, 0.f);
+    mInIm.assign(inputSize, 0.f);
+    mInMask = inputSize - 1;
+
+    mHistL.assign(2 * ConvolutionIR::kHeadSize, 0.f);
+    mHistR.assign(2 * ConvolutionIR::kHeadSize, 0.f);
+    mHeadOutL.assign(ConvolutionIR::kHeadSize, 0.f);
+    mHeadOutR.assign(ConvolutionIR::kHeadSize, 0.f);
+
+    mIdleAfter = mIR->GetLength() + 2 * maxPartition + ConvolutionIR::kHeadSize;
+  }
+
+  bool IsEmpty() const { return !mIR; }
+  int GetLength() const { return mIR ? mIR->GetLength() : 0; }
+  bool IsIdle() const { return mIdle; }
+
+  // Audio thread. Returns true when a worker level has a new input block ready.
+  // The engine works in float internally, T is whatever the caller's buffers hold.
+  template <typename T>
+  bool Process(T* left, T* right, int nFrames, double wet)
+  {
+    if (!mIR)
+      return false;
+
+    if (mIdle)
+    {
+      bool hasSignal = false;
+      for (int s = 0; s < nFrames && !hasSignal; s++)
+        hasSignal = std::fabs(left[s]) + std::fabs(right[s]) > kSilenceThreshold;
+
+      if (!hasSignal || wet <= 0.0)
+        return false;
+
+      mIdle = false;
+      mSilentSamples = 0;
+    }
+
+    const int kHead = ConvolutionIR::kHeadSize;
+    const int firstWorkerLevel = 1;
+    const int64_t startPos = mPos;
+    bool inputActive = false;
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      const float xL = (float)left[s];
+      const float xR = (float)right[s];
+      if (std::fabs(xL) + std::fabs(xR) > kSilenceThreshold)
+        inputActive = true;
+
+      const int64_t n = mPos;
+      mInRe[n & mInMask] = xL;
+      mInIm[n & mInMask] = xR;
+
+      // Direct-form head: zero latency for the first kHeadSize taps
+      mHistL[mHistPos] = mHistL[mHistPos + kHead] = xL;
+      mHistR[mHistPos] = mHistR[mHistPos + kHead] = xR;
+      const float* histL = mHistL.data() + mHistPos + 1;
+      const float* histR = mHistR.data() + mHistPos + 1;
+      const float* tapsL = mIR->mHeadL.data();
+      const float* tapsR = mIR->mHeadR.data();
+      float yL = 0.f, yR = 0.f;
+      for (int i = 0; i < kHead; i++)
+      {
+        yL += tapsL[i] * histL[i];
+        yR += tapsR[i] * histR[i];
+      }
+      mHistPos = (mHistPos + 1) & (kHead - 1);
+
+      // Level 0 output computed at the end of the previous block
+      const int headIdx = (int)(n & (kHead - 1));
+      if (mNumLevels > 0)
+      {
+        yL += mHeadOutL[headIdx];
+        yR += mHeadOutR[headIdx];
+      }
+
+      for (int l = firstWorkerLevel; l < mNumLevels; l++)
+      {
+        LevelState& level = mLevels[l];
+        if (n < level.ir->offset)
+          continue;
+
+        if (n >= level.readyUntil)
+        {
+          level.readyUntil = level.published.load(std::memory_order_acquire) * level.ir->partitionSize + level.ir->offset;
+          if (n >= level.readyUntil)
+          {
+            mUnderruns++;
+            continue;
+          }
+        }
+
+        yL += level.outL[n & level.outMask];
+        yR += level.outR[n & level.outMask];
+      }
+
+      left[s] += (T)(yL * wet);
+      right[s] += (T)(yR * wet);
+
+      mPos++;
+
+      if (mNumLevels > 0 && headIdx == kHead - 1)
+        ProcessPartitionBlock(mLevels[0], (mPos >> mLevels[0].shift) - 1);
+    }
+
+    mInputWritten.store(mPos, std::memory_order_release);
+
+    if (inputActive)
+      mSilentSamples = 0;
+    else
+      mSilentSamples = std::min<int64_t>(mSilentSamples + nFrames, mIdleAfter + 1);
+
+    if (mSilentSamples > mIdleAfter)
+      mIdle = true;
+
+    return mNumLevels > firstWorkerLevel && (mPos >> mLevels[firstWorkerLevel].shift) != (startPos >> mLevels[firstWorkerLevel].shift);
+  }
+
+  // Worker thread. Runs every ready block, shortest partitions first, up to level maxLevel. Returns false if idle.
+  bool RunWorkerJobs(int maxLevel = kMaxLevels - 1)
+  {
+    bool worked = false;
+    bool progress = true;
+    const int numLevels = std::min(mNumLevels, maxLevel + 1);
+
+    while (progress)
+    {
+      progress = false;
+      const int64_t written = mInputWritten.load(std::memory_order_acquire);
+
+      for (int l = 1; l < numLevels; l++)
+      {
+        LevelState& level = mLevels[l];
+        if ((level.blocksDone + 1) << level.shift <= written)
+        {
+          CELESTIAL_TRACE_SCOPE_ARG("Partition", l);
+          ProcessPartitionBlock(level, level.blocksDone);
+          level.blocksDone++;
+          level.published.store(level.blocksDone, std::memory_order_release);
+          progress = worked = true;
+          break;
+        }
+      }
+    }
+
+    return worked;
+  }
+
+  int GetUnderruns() const { return mUnderruns; }
+
+private:
+  struct LevelState
+  {
+    const ConvolutionIR::Level* ir = nullptr;
+    ConvolutionFFT fft;
+    int fftSize = 0;
+    int shift = 0;
+    int fdlPos = 0;
+    std::vector<float> fdlRe, fdlIm;
+    std::vector<float> workRe, workIm;
+    std::vector<float> accRe, accIm;
+    std::vector<float> outL, outR;
+    int outMask = 0;
+    int64_t blocksDone = 0;
+    int64_t readyUntil = 0;
+    std::atomic<int64_t> published {0};
+  };
+
+  // Uniformly partitioned overlap-save for input block b of one level
+  void ProcessPartitionBlock(LevelState& level, int64_t block)
+  {
+    const int T = level.ir->partitionSize;
+    const int N = level.fftSize;
+    const int P = level.ir->numPartitions;
+
+    // Input window [(b-1)T, (b+1)T), left in re and right in im
+    const int64_t start = (block - 1) * T;
+    float* xRe = level.fdlRe.data() + (size_t)level.fdlPos * N;
+    float* xIm = level.fdlIm.data() + (size_t)level.fdlPos * N;
+    for (int j = 0; j < N; j++)
+    {
+      const int64_t idx = start + j;
+      xRe[j] = idx >= 0 ? mInRe[idx & mInMask] : 0.f;
+      xIm[j] = idx >= 0 ? mInIm[idx & mInMask] : 0.f;
+    }
+    level.fft.Transform(xRe, xIm, false);
+
+    float* accRe = level.accRe.data();
+    float* accIm = level.accIm.data();
+    std::fill(level.accRe.begin(), level.accRe.end(), 0.f);
+    std::fill(level.accIm.begin(), level.accIm.end(), 0.f);
+
+    const bool stereo = !level.ir->bRe.empty();
+    for (int p = 0; p < P; p++)
+    {
+      const int slot = (level.fdlPos - p + P) % P;
+      const float* sRe = level.fdlRe.data() + (size_t)slot * N;
+      const float* sIm = level.fdlIm.data() + (size_t)slot * N;
+      const float* aRe = level.ir->aRe.data() + (size_t)p * N;
+      const float* aIm = level.ir->aIm.data() + (size_t)p * N;
+
+      for (int k = 0; k < N; k++)
+      {
+        accRe[k] += aRe[k] * sRe[k] - aIm[k] * sIm[k];
+        accIm[k] += aRe[k] * sIm[k] + aIm[k] * sRe[k];
+      }
+
+      if (stereo)
+      {
+        const float* bRe = level.ir->bRe.data() + (size_t)p * N;
+        const float* bIm = level.ir->bIm.data() + (size_t)p * N;
+        for (int k = 0; k < N; k++)
+        {
+          const int kk = (N - k) & (N - 1);
+          const float cRe = sRe[kk];
+          const float cIm = -sIm[kk];
+          accRe[k] += bRe[k] * cRe - bIm[k] * cIm;
+          accIm[k] += bRe[k] * cIm + bIm[k] * cRe;
+        }
+      }
+    }
+
+    level.fdlPos = (level.fdlPos + 1) % P;
+    level.fft.Transform(accRe, accIm, true);
+
+    // The last T samples are valid; they belong at output time bT + offset
+    if (&level == &mLevels[0])
+    {
+      std::copy(accRe + T, accRe + N, mHeadOutL.begin());
+      std::copy(accIm + T, accIm + N, mHeadOutR.begin());
+    }
+    else
+    {
+      const int64_t outStart = block * T + level.ir->offset;
+      for (int j = 0; j < T; j++)
+      {
+        level.outL[(outStart + j) & level.outMask] = accRe[T + j];
+        level.outR[(outStart + j) & level.outMask] = accIm[T + j];
+      }
+    }
+  }
+
+  static constexpr float kSilenceThreshold = 1e-5f;
+  static constexpr int kMaxLevels = 3;
+
+  std::shared_ptr<const ConvolutionIR> mIR;
+  LevelState mLevels[kMaxLevels];
+  int mNumLevels = 0;
+
+  std::vector<float> mInRe, mInIm;
+  int64_t mInMask = 0;
+  int64_t mPos = 0;
+  std::atomic<int64_t> mInputWritten {0};
+
+  std::vector<float> mHistL, mHistR;
+  int mHistPos = 0;
+  std::vector<float> mHeadOutL, mHeadOutR;
+
+  int64_t mSilentSamples = 0;
+  int64_t mIdleAfter = 0;
+  bool mIdle = true;
+  int mUnderruns = 0;
+};
+
+class ConvolutionReverb;
+
+// One worker thread for every convolution stage in the process, started by the first IR loaded and
+// joined when the last stage holding one is released. It runs the tail partitions the audio threads
+// raise and frees retired engines. With nothing loaded anywhere it blocks until a stage is loaded;
+// otherwise it polls at the shortest interval any loaded stage needs, since the audio thread never
+// signals it. While every loaded stage is idle it polls at the last level's, a few times a second.
+// IR files are read and transformed on a second thread, started by the first Load and joined when
+// its last owner cancels, so a slow load never holds up a partition another instance is waiting for.
+// Neither thread is left for the static destructor, which may run under the OS loader lock.
+class ConvolutionWorker
+{
+public:
+  static ConvolutionWorker& Get()
+  {
+    static ConvolutionWorker worker;
+    return worker;
+  }
+
+  ConvolutionWorker(const ConvolutionWorker&) = delete;
+  ConvolutionWorker& operator=(const ConvolutionWorker&) = delete;
+
+  ~ConvolutionWorker()
+  {
+    if (mLoader.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(mLoadMutex);
+        mLoaderRunning = false;
+      }
+      mLoadWake.notify_one();
+      mLoader.join();
+    }
+
+    if (mThread.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRunning = false;
+      }
+      mWake.notify_one();
+      mThread.join();
+    }
+  }
+
+  // Not on the audio thread
+  void Add(ConvolutionReverb* reverb)
+  {
+    std::lock_guard<std::mutex> startStop(mStartStopMutex);
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mReverbs.push_back(reverb);
+      if (!mThread.joinable())
+      {
+        mRunning = true;
+        mThread = std::thread(&ConvolutionWorker::Run, this);
+      }
+      mSerial++;
+    }
+    mWake.notify_one();
+  }
+
+  // Not on the audio thread. Waits out a pass that is using the stage, so it can be freed after.
+  // The last stage out stops the worker thread.
+  void Remove(ConvolutionReverb* reverb)
+  {
+    std::lock_guard<std::mutex> startStop(mStartStopMutex);
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mReverbs.erase(std::remove(mReverbs.begin(), mReverbs.end(), reverb), mReverbs.end());
+      if (!mReverbs.empty() || !mThread.joinable())
+        return;
+      mRunning = false;
+    }
+    mWake.notify_one();
+    mThread.join();
+  }
+
+  // Not on the audio thread. A stage was loaded or cleared, so a sleeping worker should look again.
+  void Notify()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mSerial++;
+    }
+    mWake.notify_one();
+  }
+
+  // Not on the audio thread. Runs load on the loader thread, after any loads queued before it.
+  // owner must call CancelLoads before it goes away.
+  void Load(const void* owner, std::function<void()> load)
+  {
+    std::lock_guard<std::mutex> startStop(mLoaderStartStopMutex);
+    {
+      std::lock_guard<std::mutex> lock(mLoadMutex);
+      mLoads.push_back({owner, std::move(load)});
+      if (std::find(mLoadOwners.begin(), mLoadOwners.end(), owner) == mLoadOwners.end())
+        mLoadOwners.push_back(owner);
+      if (!mLoader.joinable())
+      {
+        mLoaderRunning = true;
+        mLoader = std::thread(&ConvolutionWorker::RunLoads, this);
+      }
+    }
+    mLoadWake.notify_one();
+  }
+
+  // Not on the audio thread. Drops owner's queued loads and waits out one that is running, so
+  // owner can be destroyed after. The last owner out stops the loader thread.
+  void CancelLoads(const void* owner)
+  {
+    std::lock_guard<std::mutex> startStop(mLoaderStartStopMutex);
+    {
+      std::unique_lock<std::mutex> lock(mLoadMutex);
+      mLoads.erase(std::remove_if(mLoads.begin(), mLoads.end(), [owner](const LoadJob& job) { return job.owner == owner; }), mLoads.end());
+      mLoadOwners.erase(std::remove(mLoadOwners.begin(), mLoadOwners.end(), owner), mLoadOwners.end());
+      mLoadDone.wait(lock, [&] { return mLoadingOwner != owner; });
+      if (!mLoadOwners.empty() || !mLoader.joinable())
+        return;
+      mLoaderRunning = false;
+    }
+    mLoadWake.notify_one();
+    mLoader.join();
+  }
+
+private:
+  struct LoadJob
+  {
+    const void* owner;
+    std::function<void()> load;
+  };
+
+  ConvolutionWorker() = default;
+
+  inline void Run();
+
+  void RunLoads()
+  {
+    CELESTIAL_TRACE_THREAD_NAME("convolution loader");
+
+    std::unique_lock<std::mutex> lock(mLoadMutex);
+    for (;;)
+    {
+      mLoadWake.wait(lock, [&] { return !mLoads.empty() || !mLoaderRunning; });
+      if (!mLoaderRunning)
+        return;
+
+      LoadJob job = std::move(mLoads.front());
+      mLoads.pop_front();
+      mLoadingOwner = job.owner;
+
+      lock.unlock();
+      job.load();
+      lock.lock();
+
+      mLoadingOwner = nullptr;
+      mLoadDone.notify_all();
+    }
+  }
+
+  std::mutex mStartStopMutex; // serialises starting and joining mThread
+  std::thread mThread;
+  std::mutex mMutex; // held for a whole pass over mReverbs
+  std::condition_variable mWake;
+  std::vector<ConvolutionReverb*> mReverbs;
+  bool mRunning = false;
+  unsigned mSerial = 0;
+
+  std::mutex mLoaderStartStopMutex; // serialises starting and joining mLoader
+  std::thread mLoader;
+  std::mutex mLoadMutex; // guards the rest
+  std::condition_variable mLoadWake;
+  std::condition_variable mLoadDone;
+  std::deque<LoadJob> mLoads;
+  std::vector<const void*> mLoadOwners; // everyone who has called Load and not yet CancelLoads
+  const void* mLoadingOwner = nullptr;
+  bool mLoaderRunning = false;
+};
+
+// Convolution stage run by the shared ConvolutionWorker. Engines are built on the caller's thread
+// and handed to the audio thread through an atomic slot; retired engines are freed by the worker,
+// so the audio thread never allocates, frees or blocks. It doesn't signal the worker either: it
+// raises mJobsPending and the worker picks that up on its next pass. An idle engine is polled
+// slowly, and runs its own first level blocks when it wakes until the worker catches up.
+class ConvolutionReverb
+{
+public:
+  ConvolutionReverb() = default;
+  ConvolutionReverb(const ConvolutionReverb&) = delete;
+  ConvolutionReverb& operator=(const ConvolutionReverb&) = delete;
+
+  ~ConvolutionReverb() { Release(); }
+
+  // Rebuilds the engine for a new sample rate. Not on the audio thread.
+  void Reset(double sampleRate)
+  {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    mSampleRate = sampleRate;
+    mPollMicros.store(GetPollMicros(sampleRate), std::memory_order_relaxed);
+    mIdlePollMicros.store(GetIdlePollMicros(sampleRate), std::memory_order_relaxed);
+    if (mSource)
+      Post(ConvolutionIR::Get(mSource, mSampleRate));
+  }
+
+  // Loads, resamples and transforms the IR on the calling thread. Not on the audio thread.
+  void LoadImpulse(std::shared_ptr<const ImpulseResponse> source)
+  {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    mSource = std::move(source);
+    Post(ConvolutionIR::Get(mSource, mSampleRate));
+  }
+
+  void Clear() { LoadImpulse(nullptr); }
+
+  // Drops the IR and frees the engines straight away, for a stage that is no longer processed.
+  // Not while the audio thread may be in ProcessBlock.
+  void Release()
+  {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    mSource = nullptr;
+    if (mRegistered)
+    {
+      ConvolutionWorker::Get().Remove(this);
+      mRegistered = false;
+    }
+
+    mHasImpulse.store(false, std::memory_order_relaxed);
+    mActive.store(nullptr, std::memory_order_relaxed);
+    delete mPending.exchange(nullptr);
+    delete mRetired.exchange(nullptr);
+    delete mAudioEngine;
+    mAudioEngine = nullptr;
+  }
+
+  std::shared_ptr<const ImpulseResponse> GetImpulse() const
+  {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    return mSource;
+  }
+
+  // Length of the loaded IR at the session rate. Not on the audio thread.
+  int GetTailSamples() const
+  {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    if (!mSource)
+      return 0;
+    return (int)(mSource->left.size() * mSampleRate / mSource->sampleRate);
+  }
+
+  // Audio thread. Length of the IR that is playing, GetTailSamples catches up with it once a load is swapped in.
+  int GetActiveTailSamples() const { return mAudioEngine ? mAudioEngine->GetLength() : 0; }
+
+  // Audio thread. True when nothing is loaded or the current engine's tail has died away.
+  bool IsIdle() const { return !mAudioEngine || mAudioEngine->IsIdle(); }
+
+  // Audio thread. Offline renders outrun the worker, so they compute the tail partitions inline.
+  void SetRenderingOffline(bool offline) { mOffline = offline; }
+
+  // Audio thread. Swaps in an engine posted since the last block. ProcessBlock does this itself,
+  // a silent bus that skips it calls this so a cleared IR is let go and the worker can sleep.
+  void SwapPending()
+  {
+    if (mRetired.load(std::memory_order_acquire) == nullptr)
+    {
+      if (ConvolutionEngine* next = mPending.exchange(nullptr, std::memory_order_acq_rel))
+      {
+        ConvolutionEngine* old = mAudioEngine;
+        mAudioEngine = next;
+        mActive.store(next, std::memory_order_release);
+        mRetired.store(old, std::memory_order_release);
+      }
+    }
+  }
+
+  // Audio thread. Adds wet * (input convolved with the IR) in place.
+  template <typename T>
+  void ProcessBlock(T* left, T* right, int nFrames, double wet)
+  {
+    SwapPending();
+
+    if (!mAudioEngine)
+      return;
+
+    if (mOffline)
+    {
+      // No longer than a worker partition at a time, so each tail block is done before it is heard
+      const int chunk = ConvolutionIR::GetWorkerPartitionSize();
+      for (int s = 0; s < nFrames; s += chunk)
+      {
+        if (mAudioEngine->Process(left + s, right + s, std::min(chunk, nFrames - s), wet))
+        {
+          while (mJobsRunning.exchange(true, std::memory_order_acquire))
+            std::this_thread::yield();
+          mAudioEngine->RunWorkerJobs();
+          mJobsRunning.store(false, std::memory_order_release);
+        }
+      }
+      mEngineIdle.store(mAudioEngine->IsIdle());
+      return;
+    }
+
+    const bool raised = mAudioEngine->Process(left, right, nFrames, wet);
+    mEngineIdle.store(mAudioEngine->IsIdle());
+    if (!raised)
+      return;
+
+    // Just woken from idle and the worker is still on its slow poll. The first partitions are
+    // small enough to run here, the larger ones have time to wait for the worker.
+    if (mWorkerRelaxed.load() && !mJobsRunning.exchange(true, std::memory_order_acquire))
+    {
+      mAudioEngine->RunWorkerJobs(1);
+      mJobsRunning.store(false, std::memory_order_release);
+    }
+    mJobsPending.store(true, std::memory_order_release);
+  }
+
+private:
+  friend class ConvolutionWorker;
+
+  // A quarter of the worker's deadline, so a block is picked up in time at any rate
+  static int GetPollMicros(double sampleRate)
+  {
+    return std::max(100, (int)(1e6 * ConvolutionIR::GetWorkerPartitionSize() / sampleRate / 4.0));
+  }
+
+  // While the engine is idle the audio thread covers the first level when it wakes, so the worker
+  // only has to be back within half the last level's deadline
+  static int GetIdlePollMicros(double sampleRate)
+  {
+    return std::max(100, (int)(1e6 * ConvolutionIR::GetLastPartitionSize() / sampleRate / 2.0));
+  }
+
+  // Hands ir to the audio thread as a new engine, nullptr swaps out the current one. Called with mLoadMutex held.
+  void Post(std::shared_ptr<const ConvolutionIR> ir)
+  {
+    // Nothing has ever been loaded, so there is no engine to swap out and no need for the worker
+    if (!ir && !mRegistered)
+      return;
+
+    delete mPending.exchange(new ConvolutionEngine(ir), std::memory_order_acq_rel);
+    mHasImpulse.store(ir != nullptr, std::memory_order_release);
+
+    if (!mRegistered)
+    {
+      mRegistered = true;
+      ConvolutionWorker::Get().Add(this);
+    }
+    else
+      ConvolutionWorker::Get().Notify();
+  }
+
+  // Worker thread. Frees a retired engine and runs any jobs the audio thread raised. Returns how
+  // long until the stage needs looking at again, or 0 when it can't raise work until it's reloaded.
+  int RunWorker()
+  {
+    delete mRetired.exchange(nullptr, std::memory_order_acq_rel);
+
+    ConvolutionEngine* engine = mActive.load(std::memory_order_acquire);
+    const bool hasEngine = engine && !engine->IsEmpty();
+    if (hasEngine && mJobsPending.exchange(false, std::memory_order_acq_rel))
+    {
+      // Skipped while an offline render is running the jobs itself
+      if (!mJobsRunning.exchange(true, std::memory_order_acquire))
+      {
+        engine->RunWorkerJobs();
+        mJobsRunning.store(false, std::memory_order_release);
+      }
+    }
+
+    // An engine still waiting to be swapped in or out counts too
+    if (mRetired.load(std::memory_order_acquire) || mPending.load(std::memory_order_acquire))
+      return mPollMicros.load(std::memory_order_relaxed);
+    if (hasEngine || mHasImpulse.load(std::memory_order_acquire))
+    {
+      // Relaxed before looking at the engine, and the audio thread publishes a wake before looking
+      // at this, so either we see the engine awake or it sees us relaxed and covers the gap
+      mWorkerRelaxed.store(true);
+      if (mEngineIdle.load() && !mJobsPending.load(std::memory_order_acquire))
+        return mIdlePollMicros.load(std::memory_order_relaxed);
+      mWorkerRelaxed.store(false);
+      return mPollMicros.load(std::memory_order_relaxed);
+    }
+    return 0;
+  }
+
+  double mSampleRate = 44100.0;
+  std::shared_ptr<const ImpulseResponse> mSource;
+  mutable std::mutex mLoadMutex;
+  bool mRegistered = false; // with the worker, guarded by mLoadMutex
+
+  ConvolutionEngine* mAudioEngine = nullptr;
+  std::atomic<ConvolutionEngine*> mPending {nullptr};
+  std::atomic<ConvolutionEngine*> mActive {nullptr};
+  std::atomic<ConvolutionEngine*> mRetired {nullptr};
+  std::atomic<bool> mJobsPending {false};
+  std::atomic<bool> mJobsRunning {false}; // whoever sets it runs the engine's jobs
+  std::atomic<bool> mHasImpulse {false};
+  std::atomic<bool> mEngineIdle {true};     // published by the audio thread after each block
+  std::atomic<bool> mWorkerRelaxed {false}; // the worker is on the idle poll, an engine waking runs its first level itself
+  bool mOffline = false;
+  std::atomic<int> mPollMicros {GetPollMicros(44100.0)};
+  std::atomic<int> mIdlePollMicros {GetIdlePollMicros(44100.0)};
+};
+
+inline void ConvolutionWorker::Run()
+{
+  // The partition FFTs run here, so the tails need the same protection as the audio thread
+  ScopedDenormalGuard denormalGuard;
+  CELESTIAL_TRACE_THREAD_NAME("convolution worker");
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (mRunning)
+  {
+    int pollMicros = 0;
+    for (ConvolutionReverb* reverb : mReverbs)
+    {
+      const int micros = reverb->RunWorker();
+      if (micros > 0)
+        pollMicros = pollMicros > 0 ? std::min(pollMicros, micros) : micros;
+    }
+
+    // Nothing loaded anywhere, so no audio thread can raise work until a stage is loaded again.
+    // Otherwise wait out the poll interval, a stage loaded or released meanwhile cuts it short.
+    const unsigned seen = mSerial;
+    if (pollMicros == 0)
+      mWake.wait(lock, [&] { return mSerial != seen || !mRunning; });
+    else
+      mWake.wait_for(lock, std::chrono::microseconds(pollMicros), [&] { return mSerial != seen || !mRunning; });
+  }
+}
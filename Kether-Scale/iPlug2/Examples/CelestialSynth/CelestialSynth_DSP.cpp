@@ -1,42 +1,55 @@
 #include "CelestialSynth_DSP.h"
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 
 // CelestialSynthDSP constructor
-CelestialSynthDSP::CelestialSynthDSP()
+template <typename T>
+CelestialSynthDSP<T>::CelestialSynthDSP()
 {
-  // Initialize voices
+  // Initialize voices, each with its own unison phase sequence
   for (int i = 0; i < kMaxVoices; i++)
-    mVoices[i] = std::make_unique<CelestialVoice>();
+  {
+    mVoices[i] = std::make_unique<CelestialVoice<T>>();
+    mVoices[i]->SetRandomSeed(0x9E3779B9u * (uint32_t)(i + 1));
+  }
 
-  // Clear delay buffers
-  std::memset(mDelayBufferL, 0, sizeof(mDelayBufferL));
-  std::memset(mDelayBufferR, 0, sizeof(mDelayBufferR));
+  for (int i = 0; i < kMaxBuses - 1; i++)
+    mPendingNoteSplits[i].store(mNoteSplits[i], std::memory_order_relaxed);
+  for (int d = 0; d < PentatonicScaleSystem::kNumDegrees; d++)
+    mPendingRatios[d].store(1.0, std::memory_order_relaxed);
+
+  // The main bus is always there, Reset allocates the others once it knows how many are connected
+  mBuses[0].delayL.assign(kMaxDelayBufferSize, T(0));
+  mBuses[0].delayR.assign(kMaxDelayBufferSize, T(0));
 }
 
 // CelestialVoice waveform generation
-double CelestialVoice::GenerateWaveform()
+template <typename T>
+T CelestialVoice<T>::GenerateWaveform()
 {
-  double output = 0.0;
+  T output = T(0);
 
+  // Phase is accumulated in double, only the waveform value drops to T
   switch (mWaveform)
   {
     case WaveformType::kSine:
-      output = std::sin(mPhase * 2.0 * 3.14159265359);
+      output = (T)std::sin(mPhase * 2.0 * 3.14159265359);
       break;
 
     case WaveformType::kSaw:
-      output = 2.0 * (mPhase - 0.5);
+      output = (T)(2.0 * (mPhase - 0.5));
       break;
 
     case WaveformType::kSquare:
-      output = (mPhase < 0.5) ? 1.0 : -1.0;
+      output = (mPhase < 0.5) ? T(1) : T(-1);
       break;
 
     case WaveformType::kTriangle:
       if (mPhase < 0.5)
-        output = 4.0 * mPhase - 1.0;
+        output = (T)(4.0 * mPhase - 1.0);
       else
-        output = 3.0 - 4.0 * mPhase;
+        output = (T)(3.0 - 4.0 * mPhase);
       break;
   }
 
@@ -48,234 +61,1091 @@ double CelestialVoice::GenerateWaveform()
   return output;
 }
 
-void CelestialVoice::SetFrequency(double freq)
+template <typename T>
+void CelestialVoice<T>::SetFrequency(double freq)
 {
   mFrequency = freq;
-  mPhaseIncrement = freq / mSampleRate;
+  mBaseIncrement = freq / mSampleRate;
+  mPhaseIncrement = mBaseIncrement * mPitchMod;
   mOsc.SetFreqCPS(freq); // Keep for sine wave
 }
 
-void CelestialVoice::SetSampleRate(double sr)
+template <typename T>
+void CelestialVoice<T>::SetSampleRate(double sr)
 {
   mSampleRate = sr;
   mOsc.SetSampleRate(sr);
   mFilter.SetSampleRate(sr);
+  mFilterR.SetSampleRate(sr);
   mEnvelope.SetSampleRate(sr);
-  mPhaseIncrement = mFrequency / mSampleRate;
+  mBaseIncrement = mFrequency / mSampleRate;
+  mPhaseIncrement = mBaseIncrement * mPitchMod;
+}
+
+template <typename T>
+void CelestialVoice<T>::SetModulation(double pitchMult, double cutoffMult, int nSamples)
+{
+  // Gravity glide: an exponential approach to the target pitch, one exp per control block
+  if (mGlideOctaves != 0.0)
+  {
+    mGlideOctaves = mGlideTimeMs > 0.0 ? mGlideOctaves * std::exp(-nSamples * 1000.0 / (mGlideTimeMs * mSampleRate)) : 0.0;
+    if (std::fabs(mGlideOctaves) < 1e-5) // well under a cent
+      mGlideOctaves = 0.0;
+    pitchMult *= std::exp2(mGlideOctaves);
+  }
+
+  mPitchModStep = (pitchMult - mPitchMod) / nSamples;
+  const double cutoff = std::min(mFilterCutoff * cutoffMult, mSampleRate * 0.45);
+  mFilter.RampCutoff(cutoff, nSamples);
+  if (mUnisonCount > 1)
+    mFilterR.RampCutoff(cutoff, nSamples);
 }
 
 // CelestialVoice implementation
-bool CelestialVoice::GetBusy() const
+template <typename T>
+bool CelestialVoice<T>::GetBusy() const
 {
   return mEnvelope.IsActive();
 }
 
-void CelestialVoice::Trigger(double level, bool isRetrigger)
+template <typename T>
+void CelestialVoice<T>::Trigger(double level, bool isRetrigger)
 {
   mVoiceGain = level;
+  mHolds = kHoldKey;
   mEnvelope.Trigger();
   if (!isRetrigger)
   {
     mPhase = 0.0;
     mOsc.Reset();
     mFilter.Reset();
+    mFilterR.Reset();
+
+    // Random start phases so the stack doesn't open with every lane in step
+    for (int i = 0; i < kMaxUnison; i++)
+    {
+      mRandomState = mRandomState * 1664525u + 1013904223u;
+      mUnisonPhase[i] = (mRandomState >> 8) * (1.0 / 16777216.0);
+    }
   }
 }
 
-void CelestialVoice::Release()
+template <typename T>
+void CelestialVoice<T>::Release()
 {
+  mHolds = 0;
   mEnvelope.Release();
 }
 
-void CelestialVoice::ProcessSamplesAccumulating(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIdx, int nSamples)
+template <typename T>
+void CelestialVoice<T>::DropHold(int hold)
+{
+  if (!(mHolds & hold))
+    return;
+
+  mHolds &= ~hold;
+  if (mHolds == 0)
+    Release();
+}
+
+template <typename T>
+void CelestialVoice<T>::Kill()
+{
+  mHolds = 0;
+  mEnvelope.Reset();
+  mFilter.Reset();
+  mFilterR.Reset();
+  mOsc.Reset();
+  mPhase = 0.0;
+  mPitchMod = 1.0;
+  mPitchModStep = 0.0;
+  mGlideOctaves = 0.0;
+  mPhaseIncrement = mBaseIncrement;
+}
+
+template <typename T>
+void CelestialVoice<T>::GlideTo(double freq, double fromFreq)
+{
+  // Carry on from the pitch we're at now, so a glide interrupted by another note stays continuous.
+  // mPitchMod is rescaled so the first sample of the new note plays at the old pitch.
+  if (mGlideTimeMs > 0.0 && (mNote >= 0 || fromFreq > 0.0) && freq > 0.0)
+  {
+    // A given start pitch replaces whatever glide the voice was still in
+    if (fromFreq > 0.0)
+    {
+      mPitchMod /= std::exp2(mGlideOctaves);
+      mGlideOctaves = 0.0;
+    }
+
+    const double ratio = (fromFreq > 0.0 ? fromFreq : mFrequency) / freq;
+    mGlideOctaves += std::log2(ratio);
+    mPitchMod *= ratio;
+  }
+  else
+  {
+    mPitchMod /= std::exp2(mGlideOctaves);
+    mGlideOctaves = 0.0;
+  }
+
+  SetFrequency(freq);
+}
+
+template <typename T>
+void CelestialVoice<T>::ProcessSamplesAccumulating(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIdx, int nSamples)
 {
+  // SynthVoice interface, in the host's sample type
+  if constexpr (std::is_same<T, sample>::value)
+  {
+    ProcessAccumulating(outputs, nOutputs, startIdx, nSamples);
+  }
+  else
+  {
+    T scratch[2][64];
+    T* scratchPtrs[2] = {scratch[0], scratch[1]};
+    const int nChans = std::min(nOutputs, 2);
+    for (int start = 0; start < nSamples; start += 64)
+    {
+      const int n = std::min(64, nSamples - start);
+      for (int c = 0; c < nChans; c++)
+        std::fill(scratch[c], scratch[c] + n, T(0));
+      ProcessAccumulating(scratchPtrs, nChans, 0, n);
+
+      for (int c = 0; c < nChans; c++)
+      {
+        for (int s = 0; s < n; s++)
+          outputs[c][startIdx + start + s] += (sample)scratch[c][s];
+      }
+    }
+  }
+}
+
+template <typename T>
+void CelestialVoice<T>::ProcessAccumulating(T** outputs, int nOutputs, int startIdx, int nSamples)
+{
+  const T gain = (T)mVoiceGain;
+
   for (int s = startIdx; s < startIdx + nSamples; s++)
   {
+    // Motion vibrato, interpolated from the control rate targets
+    mPhaseIncrement = mBaseIncrement * mPitchMod;
+    mPitchMod += mPitchModStep;
+
+    if (mUnisonCount > 1)
+    {
+      // Unison stack, filtered per side
+      T stackL, stackR;
+      RenderUnison(stackL, stackR);
+
+      const T amp = mEnvelope.Process() * gain;
+      const T outL = mFilter.Process(stackL) * amp;
+      const T outR = mFilterR.Process(stackR) * amp;
+
+      if (nOutputs > 1)
+      {
+        outputs[0][s] += outL * mPanGainL;
+        outputs[1][s] += outR * mPanGainR;
+      }
+      else if (nOutputs == 1)
+      {
+        outputs[0][s] += (outL + outR) * T(0.5 * kOutputScale);
+      }
+      continue;
+    }
+
     // Generate waveform
-    double oscOutput = (mWaveform == WaveformType::kSine) ? mOsc.Process() : GenerateWaveform();
+    T oscOutput = (mWaveform == WaveformType::kSine) ? mOsc.Process(mPhaseIncrement * mSampleRate) : GenerateWaveform();
 
     // Apply filter
-    double filtered = mFilter.Process(oscOutput);
+    T filtered = mFilter.Process(oscOutput);
 
     // Get envelope value
-    double envelope = mEnvelope.Process();
+    T envelope = mEnvelope.Process();
 
     // Apply velocity and envelope
-    double sample = filtered * envelope * mVoiceGain;
+    T out = filtered * envelope * gain;
+
+    // Accumulate to outputs, placed by the pan gains set at note-on
+    if (nOutputs > 1)
+    {
+      outputs[0][s] += out * mPanGainL;
+      outputs[1][s] += out * mPanGainR;
+    }
+    else if (nOutputs == 1)
+    {
+      outputs[0][s] += out * T(kOutputScale);
+    }
+  }
+}
+
+template <typename T>
+void CelestialVoice<T>::RenderUnison(T& left, T& right)
+{
+  // Advance every lane, phases stay in double
+  alignas(32) double phase[kMaxUnison];
+  for (int i = 0; i < kMaxUnison; i++)
+  {
+    double p = mUnisonPhase[i] + mPhaseIncrement * mUnisonRatio[i];
+    p -= (p >= 1.0) ? 1.0 : 0.0;
+    mUnisonPhase[i] = p;
+    phase[i] = p;
+  }
+
+  // Shape, one branch-free lane loop per waveform
+  alignas(32) T wave[kMaxUnison];
+  switch (mWaveform)
+  {
+    case WaveformType::kSine:
+      for (int i = 0; i < kMaxUnison; i++)
+      {
+        // Parabolic sine with one correction step, |error| < 0.001
+        const double x = 0.5 - phase[i];
+        const double y = 8.0 * x - 16.0 * x * std::fabs(x);
+        wave[i] = (T)(0.225 * (y * std::fabs(y) - y) + y);
+      }
+      break;
+
+    case WaveformType::kSaw:
+      for (int i = 0; i < kMaxUnison; i++)
+        wave[i] = (T)(2.0 * phase[i] - 1.0);
+      break;
+
+    case WaveformType::kSquare:
+      for (int i = 0; i < kMaxUnison; i++)
+        wave[i] = phase[i] < 0.5 ? T(1) : T(-1);
+      break;
+
+    case WaveformType::kTriangle:
+      for (int i = 0; i < kMaxUnison; i++)
+        wave[i] = (T)(1.0 - 4.0 * std::fabs(phase[i] - 0.5));
+      break;
+
+    default:
+      for (int i = 0; i < kMaxUnison; i++)
+        wave[i] = T(0);
+      break;
+  }
+
+  // Fan out to the two sides
+  T sumL = T(0), sumR = T(0);
+  for (int i = 0; i < kMaxUnison; i++)
+  {
+    sumL += wave[i] * mUnisonGainL[i];
+    sumR += wave[i] * mUnisonGainR[i];
+  }
+
+  left = sumL;
+  right = sumR;
+}
 
-    // Accumulate to outputs
-    for (int c = 0; c < nOutputs; c++)
+template <typename T>
+void CelestialVoice<T>::SetUnison(int count, double detuneCents, double width)
+{
+  mUnisonCount = std::min((int)kMaxUnison, std::max(1, count));
+
+  // Lanes evenly spaced across the detune range and the stereo field, scaled to keep the stack's
+  // power close to a single oscillator's
+  const double norm = std::sqrt(2.0 / mUnisonCount);
+  for (int i = 0; i < kMaxUnison; i++)
+  {
+    if (i >= mUnisonCount)
     {
-      outputs[c][s] += sample * 0.3; // Scale output
+      mUnisonRatio[i] = 1.0;
+      mUnisonGainL[i] = mUnisonGainR[i] = T(0);
+      continue;
     }
+
+    const double offset = mUnisonCount > 1 ? (2.0 * i / (mUnisonCount - 1) - 1.0) : 0.0;
+    mUnisonRatio[i] = std::exp2(offset * detuneCents / 1200.0);
+
+    const double angle = (std::min(1.0, std::max(-1.0, offset * width)) + 1.0) * 0.25 * 3.14159265359;
+    mUnisonGainL[i] = (T)(norm * std::cos(angle));
+    mUnisonGainR[i] = (T)(norm * std::sin(angle));
   }
 }
 
+template <typename T>
+void CelestialVoice<T>::SetPan(double pan)
+{
+  // Equal power, scaled so the centre keeps the old unpanned level
+  mPan = std::min(1.0, std::max(-1.0, pan));
+  const double angle = (mPan + 1.0) * 0.25 * 3.14159265359;
+  mPanGainL = (T)(kOutputScale * std::sqrt(2.0) * std::cos(angle));
+  mPanGainR = (T)(kOutputScale * std::sqrt(2.0) * std::sin(angle));
+}
+
 // CelestialSynthDSP implementation
-void CelestialSynthDSP::ProcessBlock(sample** inputs, sample** outputs, int nInputs, int nOutputs, int nFrames, double qnPos)
+template <typename T>
+void CelestialSynthDSP<T>::ProcessBlock(T** inputs, T** outputs, int nInputs, int nOutputs, int nFrames, double qnPos)
 {
+  // Flush denormals to zero while we run, decaying tails would otherwise crawl through them
+  ScopedDenormalGuard denormalGuard;
+  CELESTIAL_RT_AUDIT_SCOPE();
+
+  CELESTIAL_TRACE_THREAD_NAME("audio");
+  CELESTIAL_TRACE_SCOPE_ARG("ProcessBlock", nFrames);
+  mLoad.BeginBlock();
+
+  ApplyPendingState();
+
   // Clear outputs
   for (int c = 0; c < nOutputs; c++)
   {
-    for (int s = 0; s < nFrames; s++)
-    {
-      outputs[c][s] = 0.0;
-    }
+    std::memset(outputs[c], 0, nFrames * sizeof(T));
   }
 
-  // Limit active voices based on mVoiceCount
-  int activeVoices = std::min(mVoiceCount, kMaxVoices);
+  const int nBuses = std::min(mAllocatedBuses.load(std::memory_order_relaxed), (nOutputs + 1) / 2);
 
-  // Process active voices
+  // Silent blocks count towards the meter window too, so it falls back to zero
+  mMeterFrames += nFrames;
+
+  // A bus the host has just disconnected drops its tails, so it starts clean if it comes back
+  for (int b = 1; b < kMaxBuses; b++)
+  {
+    const bool connected = b < nBuses && mBusConnected[b];
+    if (mBuses[b].connected && !connected)
+      ClearBus(mBuses[b]);
+    mBuses[b].connected = connected;
+  }
+
+  // mVoiceCount only limits allocation, so voices above a lowered count (e.g. after a preset
+  // change) play out their release instead of freezing. Idle voices cost a flag check.
+  const int activeVoices = kMaxVoices;
+
+  // Voices routed to a bus that isn't connected play through the first bus
+  int voiceBus[kMaxVoices] = {};
+  bool busVoices[kMaxBuses] = {};
+  int busyVoices = 0;
   for (int v = 0; v < activeVoices; v++)
   {
+    const int bus = mVoices[v]->GetBus();
+    voiceBus[v] = (bus > 0 && bus < kMaxBuses && mBuses[bus].connected) ? bus : 0;
     if (mVoices[v]->GetBusy())
     {
-      mVoices[v]->ProcessSamplesAccumulating(inputs, outputs, nInputs, nOutputs, 0, nFrames);
+      busVoices[voiceBus[v]] = true;
+      busyVoices++;
     }
   }
 
-  // Apply Five Sacred Controls processing
-  for (int c = 0; c < nOutputs; c++)
+  // Once a bus has no voices and every tail downstream has decayed, it is just the memset above
+  const int tailSamples = GetDelayTailSamples() + kFilterTailSamples;
+  bool busActive[kMaxBuses] = {};
+  bool anyActive = false;
+
+  for (int b = 0; b < nBuses; b++)
   {
-    for (int s = 0; s < nFrames; s++)
-    {
-      double sample = outputs[c][s];
+    Bus& bus = mBuses[b];
+    if (!bus.connected)
+      continue;
 
-      // BRILLIANCE - High frequency emphasis/filtering
-      if (mBrilliance > 0.5)
-      {
-        sample *= (1.0 + (mBrilliance - 0.5) * 2.0); // Boost for brightness
-      }
-      else
+    if (busVoices[b])
+      bus.samplesSinceVoices = 0;
+    else
+      bus.samplesSinceVoices = std::min(bus.samplesSinceVoices + nFrames, tailSamples + 1);
+
+    if (!busVoices[b] && bus.samplesSinceVoices > tailSamples && bus.reverb.IsIdle() && bus.convolution.IsIdle())
+    {
+      if (!bus.silent)
       {
-        sample *= (mBrilliance * 2.0); // Subtle dampening
+        // Drop whatever the filters and delay lines were still holding so we resume from a clean state
+        bus.eq.Reset();
+        bus.saturator.Reset();
+        std::fill(bus.delayL.begin(), bus.delayL.end(), T(0));
+        std::fill(bus.delayR.begin(), bus.delayR.end(), T(0));
+        bus.delayWritePos = 0;
+        bus.silent = true;
       }
+      bus.convolution.SwapPending();
+      continue;
+    }
+
+    bus.silent = false;
+    busActive[b] = true;
+    anyActive = true;
+  }
 
-      // MOTION - Subtle frequency modulation/vibrato
-      mMotionPhase += 0.01 * mMotion;
-      sample *= (1.0 + std::sin(mMotionPhase) * mMotion * 0.1);
+  PublishVoiceSnapshot();
 
-      // SPACE - Stereo width and reverb-like effect
-      if (c == 1 && nOutputs > 1) // Right channel
+  // Notes arriving before the next block glide in from the last note, but only while it still sounds.
+  // Notes played together in one block all start from this, so a chord doesn't slide into itself.
+  mGlideFromFreq = 0.0;
+  for (int v = 0; v < kMaxVoices && mLastNote >= 0; v++)
+  {
+    if (mVoices[v]->IsPlayingNote(mLastNote))
+    {
+      mGlideFromFreq = mLastNoteFreq;
+      break;
+    }
+  }
+
+  // The settings are fixed for this block now. The UI thread sizes the host's tail from this,
+  // it can't read the effect state while we're processing.
+  mPublishedTailSamples.store(GetTailSamples(mBuses[0].convolution.GetActiveTailSamples()), std::memory_order_relaxed);
+
+  if (!anyActive)
+  {
+    mLoad.EndBlock(nFrames, 0);
+    return;
+  }
+
+  mLoad.SkipStage();
+
+  // MOTION - Vibrato and filter movement, LFOs evaluated at control rate and ramped per voice
+  const double vibratoDepth = mMotion * kMotionVibratoSemitones / 12.0;
+  const double filterDepth = mMotion * kMotionFilterOctaves;
+
+  for (int start = 0; start < nFrames; start += kControlBlockSize)
+  {
+    const int n = std::min(kControlBlockSize, nFrames - start);
+    mMotionLFO.Advance(n);
+
+    // Process active voices
+    for (int v = 0; v < activeVoices; v++)
+    {
+      if (mVoices[v]->GetBusy())
       {
-        sample *= (1.0 + mSpace * 0.3);
+        CELESTIAL_TRACE_SCOPE_ARG("Voice", v);
+        const int firstChan = 2 * voiceBus[v];
+        const double lfo = mMotionLFO.GetValue(v);
+        mVoices[v]->SetModulation(std::exp2(lfo * vibratoDepth), std::exp2(lfo * filterDepth), n);
+        mVoices[v]->ProcessAccumulating(outputs + firstChan, std::min(2, nOutputs - firstChan), start, n);
       }
+    }
+  }
+
+  mLoad.EndStage(CelestialLoadReading::kStageVoices);
+
+  for (int b = 0; b < nBuses; b++)
+  {
+    if (!busActive[b])
+      continue;
 
-      // WARMTH - Soft saturation/warmth
-      if (mWarmth > 0.1)
+    T** io = outputs + 2 * b;
+    const int nChans = std::min(2, nOutputs - 2 * b);
+
+    // A NaN/Inf from the voices would poison every effect downstream, so stop them here
+    if (!IsBlockFinite(io, nChans, nFrames))
+    {
+      for (int v = 0; v < activeVoices; v++)
       {
-        double warmthAmount = mWarmth * 0.5;
-        sample = std::tanh(sample * (1.0 + warmthAmount)) / (1.0 + warmthAmount * 0.5);
+        if (voiceBus[v] == b)
+          mVoices[v]->Kill();
       }
 
-      // PURITY - Clean/dirty factor
-      if (mPurity < 0.9)
+      for (int c = 0; c < nChans; c++)
+        std::memset(io[c], 0, nFrames * sizeof(T));
+
+      mNonFiniteResets.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    mLoad.SkipStage();
+    {
+      CELESTIAL_TRACE_SCOPE_ARG("Bus", b);
+      ProcessBusEffects(mBuses[b], io, nChans, nFrames);
+    }
+
+    // Final pass: peak and power for the meter, and a NaN/Inf in either means the block is bad.
+    // Anything that got through is in the feedback paths, clear them and output silence for this block.
+    T peak[2] = {}, sumSquares[2] = {};
+    if (!MeasureBlock(io, nChans, nFrames, peak, sumSquares))
+    {
+      ClearBus(mBuses[b]);
+
+      for (int c = 0; c < nChans; c++)
+        std::memset(io[c], 0, nFrames * sizeof(T));
+
+      mNonFiniteResets.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (b == 0)
+    {
+      for (int c = 0; c < 2; c++)
       {
-        double distortion = (1.0 - mPurity) * 0.2;
-        sample = std::tanh(sample * (1.0 + distortion));
+        const int src = std::min(c, nChans - 1);
+        mMeterPeak[c] = std::max(mMeterPeak[c], (double)peak[src]);
+        mMeterSumSquares[c] += (double)sumSquares[src];
       }
+    }
+  }
 
-      // Apply master gain
-      sample *= mGain;
+  mLoad.EndBlock(nFrames, busyVoices);
+}
 
-      // Apply delay effect
-      if (mDelayMix > 0.01)
-      {
-        int delaySamples = (int)((mDelayTime / 1000.0) * mSampleRate);
-        delaySamples = std::min(delaySamples, kMaxDelayBufferSize - 1);
+template <typename T>
+void CelestialSynthDSP<T>::PublishVoiceSnapshot()
+{
+  if (!mVoiceSnapshotEnabled.load(std::memory_order_relaxed))
+  {
+    mVoiceSnapshotSignature = kNoSnapshot; // so the first block after enabling always publishes
+    return;
+  }
 
-        int readPos = mDelayWritePos - delaySamples;
-        if (readPos < 0) readPos += kMaxDelayBufferSize;
+  // Levels are compared at the resolution the view can show, so held notes and silence publish
+  // nothing and the constellation stops redrawing until something visibly moves
+  CelestialVoiceSnapshot& snapshot = mVoiceSnapshots.GetWriteSlot();
+  uint64_t signature = 14695981039346656037ull;
+  int n = 0;
+  for (int v = 0; v < kMaxVoices; v++)
+  {
+    const CelestialVoice<T>& voice = *mVoices[v];
+    if (!voice.GetBusy())
+      continue;
 
-        double delayedSample = (c == 0) ? mDelayBufferL[readPos] : mDelayBufferR[readPos];
-        sample = sample * (1.0 - mDelayMix) + delayedSample * mDelayMix;
+    CelestialVoiceState& state = snapshot.voices[n++];
+    state.note = voice.GetNote();
+    state.degree = mScaleSystem.MapMidiNoteToScaleIndex(std::max(0, state.note)) % PentatonicScaleSystem::kNumDegrees;
+    state.level = (float)voice.GetEnvelopeLevel();
+    state.pan = (float)voice.GetPan();
+    state.bus = voice.GetBus();
 
-        // Write to delay buffer with feedback
-        if (c == 0)
-          mDelayBufferL[mDelayWritePos] = sample + delayedSample * mDelayFeedback;
-        else
-          mDelayBufferR[mDelayWritePos] = sample + delayedSample * mDelayFeedback;
-      }
+    const uint64_t key = ((uint64_t)v << 40) | ((uint64_t)(state.note & 0xff) << 32) | ((uint64_t)(state.bus & 0xff) << 24)
+                       | ((uint64_t)(int)(state.level * kSnapshotLevelSteps) << 8) | (uint64_t)(int)((state.pan + 1.f) * 100.f);
+    signature = (signature ^ key) * 1099511628211ull;
+  }
+  snapshot.numVoices = n;
 
-      outputs[c][s] = sample;
-    }
+  if (signature == mVoiceSnapshotSignature)
+    return;
+
+  mVoiceSnapshotSignature = signature;
+  mVoiceSnapshots.Publish();
+}
+
+template <typename T>
+bool CelestialSynthDSP<T>::ReadVoiceSnapshot(CelestialVoiceSnapshot& dest)
+{
+  if (!mVoiceSnapshots.Acquire())
+    return false;
+
+  const CelestialVoiceSnapshot& snapshot = mVoiceSnapshots.GetReadSlot();
+  dest.numVoices = snapshot.numVoices;
+  std::copy(snapshot.voices, snapshot.voices + snapshot.numVoices, dest.voices);
+  return true;
+}
+
+template <typename T>
+bool CelestialSynthDSP<T>::TakeMeterReading(int windowFrames, MeterReading& reading)
+{
+  if (mMeterFrames < windowFrames || mMeterFrames <= 0)
+    return false;
 
-    // Advance delay write position
-    mDelayWritePos++;
-    if (mDelayWritePos >= kMaxDelayBufferSize)
-      mDelayWritePos = 0;
+  for (int c = 0; c < 2; c++)
+  {
+    reading.peak[c] = (float)mMeterPeak[c];
+    reading.rms[c] = (float)std::sqrt(mMeterSumSquares[c] / mMeterFrames);
+    mMeterPeak[c] = 0.0;
+    mMeterSumSquares[c] = 0.0;
   }
+
+  mMeterFrames = 0;
+  return true;
 }
 
-void CelestialSynthDSP::ProcessMidiMsg(const IMidiMsg& msg)
+template <typename T>
+void CelestialSynthDSP<T>::ProcessBusEffects(Bus& bus, T** io, int nChans, int nFrames)
 {
-  if (msg.StatusMsg() == IMidiMsg::kNoteOn)
+  // Apply Five Sacred Controls processing. Each stage has its own trace scope, split where the
+  // load meter splits its stages.
+
+  // BRILLIANCE - Tilt EQ around 2kHz, brighter above 0.5 and darker below at constant level
   {
-    int note = msg.NoteNumber();
-    int velocity = msg.Velocity();
+    CELESTIAL_TRACE_SCOPE("TiltEQ");
+    bus.eq.ProcessBlock(io, nChans, nFrames);
+  }
 
-    // Handle velocity 0 as note-off (MIDI standard)
-    if (velocity == 0)
+  // WARMTH / PURITY - Soft saturation, oversampled around the waveshaper only
+  {
+    CELESTIAL_TRACE_SCOPE("Saturation");
+    bus.saturator.ProcessBlock(io, nChans, nFrames);
+  }
+  mLoad.EndStage(CelestialLoadReading::kStageTone);
+
+  const T gain = (T)mGain;
+  const T delayMix = (T)mDelayMix;
+  const T delayFeedback = (T)mDelayFeedback;
+  T* delayBuffers[2] = {bus.delayL.data(), bus.delayR.data()};
+
+  {
+    CELESTIAL_TRACE_SCOPE("Delay");
+    for (int s = 0; s < nFrames; s++)
     {
-      for (int v = 0; v < mVoiceCount && v < kMaxVoices; v++)
+      for (int c = 0; c < nChans; c++)
       {
-        if (mVoices[v]->IsPlayingNote(note))
+        T sample = io[c][s];
+
+        // Apply master gain
+        sample *= gain;
+
+        // Apply delay effect
+        if (mDelayMix > 0.01)
         {
-          mVoices[v]->Release();
+          int delaySamples = (int)((mDelayTime / 1000.0) * mSampleRate);
+          delaySamples = std::min(delaySamples, kMaxDelayBufferSize - 1);
+
+          int readPos = bus.delayWritePos - delaySamples;
+          if (readPos < 0) readPos += kMaxDelayBufferSize;
+
+#if CELESTIAL_FUZZ
+          // Fuzz builds check the index instead of trusting the clamps, an abort is what the fuzzer reports
+          if (readPos < 0 || readPos >= kMaxDelayBufferSize)
+            std::abort();
+#endif
+
+          T delayedSample = delayBuffers[c][readPos];
+          sample = sample * (T(1) - delayMix) + delayedSample * delayMix;
+
+          // Write to delay buffer with feedback
+          delayBuffers[c][bus.delayWritePos] = sample + delayedSample * delayFeedback;
         }
+
+        io[c][s] = sample;
       }
-      return;
+
+      // Advance delay write position once per frame so both channels share it
+      bus.delayWritePos++;
+      if (bus.delayWritePos >= kMaxDelayBufferSize)
+        bus.delayWritePos = 0;
     }
+  }
+  mLoad.EndStage(CelestialLoadReading::kStageDelay);
 
-    // Find free voice for note-on
-    for (int v = 0; v < mVoiceCount && v < kMaxVoices; v++)
+  // SPACE - Mid/side width first, then the FDN reverb sized by Space and sent at ReverbMix.
+  // The reverb costs nothing once its tail has decayed.
+  if (nChans > 1)
+  {
     {
-      if (!mVoices[v]->GetBusy())
-      {
-        // Use pentatonic scale system for frequency calculation
-        // Base frequency is C4 (MIDI 60) = 261.6256 Hz
-        double baseFreq = 261.6256;
-        double freq = mScaleSystem.GetFrequencyForMidiNote(note, baseFreq);
-
-        // Apply timbre shift
-        freq *= std::pow(2.0, mTimbreShift * 0.1);
-
-        // Set voice parameters
-        mVoices[v]->SetFrequency(freq);
-        mVoices[v]->SetWaveform(mWaveform);
-        mVoices[v]->SetFilterCutoff(mFilterCutoff);
-        mVoices[v]->SetFilterResonance(mFilterResonance);
-        mVoices[v]->SetAttack(mAttack);
-        mVoices[v]->SetDecay(mDecay);
-        mVoices[v]->SetSustain(mSustain);
-        mVoices[v]->SetReleaseTime(mRelease);
-        mVoices[v]->SetNote(note, velocity);
-
-        // Apply velocity scaling with warmth
-        double scaledVelocity = (velocity / 127.0) * (0.5 + mWarmth * 0.5);
-        mVoices[v]->Trigger(scaledVelocity, false);
-        break;
-      }
+      CELESTIAL_TRACE_SCOPE("Width");
+      bus.width.ProcessBlock(io, nFrames);
+    }
+
+    {
+      CELESTIAL_TRACE_SCOPE("Reverb");
+      bus.reverb.ProcessBlock(io[0], io[1], nFrames, mReverbMix * mSpace);
+    }
+    mLoad.EndStage(CelestialLoadReading::kStageSpace);
+
+    // Convolution with the loaded impulse response, tail partitions run on the worker thread
+    {
+      CELESTIAL_TRACE_SCOPE("Convolution");
+      bus.convolution.ProcessBlock(io[0], io[1], nFrames, mConvolutionMix);
     }
+    mLoad.EndStage(CelestialLoadReading::kStageConvolution);
+  }
+}
+
+template <typename T>
+bool CelestialSynthDSP<T>::MeasureBlock(T** outputs, int nOutputs, int nFrames, T* peak, T* sumSquares)
+{
+  for (int c = 0; c < nOutputs; c++)
+  {
+    T channelPeak = T(0), channelSum = T(0);
+    for (int s = 0; s < nFrames; s++)
+    {
+      const T x = outputs[c][s];
+      channelPeak = std::max(channelPeak, std::fabs(x));
+      channelSum += x * x;
+    }
+    peak[c] = channelPeak;
+    sumSquares[c] = channelSum;
+  }
+
+  // max() drops NaNs, so finiteness is judged on the power sum, which carries both NaN and Inf
+  for (int c = 0; c < nOutputs; c++)
+  {
+    if (!std::isfinite(sumSquares[c]))
+      return false;
+  }
+  return true;
+}
+
+template <typename T>
+bool CelestialSynthDSP<T>::IsBlockFinite(T** outputs, int nOutputs, int nFrames)
+{
+  // One sum per block: any NaN or Inf sample carries through to the total
+  T sum = T(0);
+  for (int c = 0; c < nOutputs; c++)
+  {
+    for (int s = 0; s < nFrames; s++)
+      sum += outputs[c][s];
+  }
+  return std::isfinite(sum);
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::ClearBus(Bus& bus)
+{
+  std::fill(bus.delayL.begin(), bus.delayL.end(), T(0));
+  std::fill(bus.delayR.begin(), bus.delayR.end(), T(0));
+  bus.eq.Reset();
+  bus.saturator.Reset();
+  bus.reverb.Clear();
+  // The convolution only ever sees the checked signal above, its state can't go non-finite unless the IR is
+}
+
+template <typename T>
+bool CelestialSynthDSP<T>::IsOutputSilent() const
+{
+  for (const Bus& bus : mBuses)
+  {
+    if (bus.connected && !bus.silent)
+      return false;
+  }
+  return true;
+}
+
+template <typename T>
+int CelestialSynthDSP<T>::GetRoutedBus(int note, int velocity, int channel) const
+{
+  switch (mRouting)
+  {
+    case kRoutingNoteRange:
+    {
+      int bus = 0;
+      while (bus < kMaxBuses - 1 && note >= mNoteSplits[bus])
+        bus++;
+      return bus;
+    }
+    case kRoutingMidiChannel:
+      return channel % kMaxBuses;
+    case kRoutingVelocity:
+      return std::min(kMaxBuses - 1, velocity * kMaxBuses / 128);
+    default:
+      return 0;
+  }
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::ProcessMidiMsg(const IMidiMsg& msg)
+{
+  CELESTIAL_RT_AUDIT_SCOPE();
+
+  if (msg.StatusMsg() == IMidiMsg::kNoteOn)
+  {
+    // Handle velocity 0 as note-off (MIDI standard)
+    if (msg.Velocity() == 0)
+      NoteOff(msg.NoteNumber());
+    else
+      NoteOn(msg.NoteNumber(), msg.Velocity(), msg.Channel());
   }
   else if (msg.StatusMsg() == IMidiMsg::kNoteOff)
   {
-    int note = msg.NoteNumber();
-    // Release only voices playing this specific note
-    for (int v = 0; v < mVoiceCount && v < kMaxVoices; v++)
+    NoteOff(msg.NoteNumber());
+  }
+  else if (msg.StatusMsg() == IMidiMsg::kControlChange)
+  {
+    switch (msg.ControlChangeIdx())
     {
-      if (mVoices[v]->IsPlayingNote(note))
-      {
-        mVoices[v]->Release();
-      }
+      case IMidiMsg::kSustainOnOff:
+        SetSustainPedal(IMidiMsg::ControlChangeOnOff(msg.ControlChange(IMidiMsg::kSustainOnOff)));
+        break;
+      case IMidiMsg::kSustenutoOnOff:
+        SetSostenutoPedal(IMidiMsg::ControlChangeOnOff(msg.ControlChange(IMidiMsg::kSustenutoOnOff)));
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::SetSustainPedal(bool down)
+{
+  if (down == mSustainDown)
+    return;
+
+  mSustainDown = down;
+
+  // Pedal up releases everything it was holding in one pass over the voices
+  if (!down)
+  {
+    for (int v = 0; v < kMaxVoices; v++)
+      mVoices[v]->DropHold(CelestialVoice<T>::kHoldSustain);
+  }
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::SetSostenutoPedal(bool down)
+{
+  if (down == mSostenutoDown)
+    return;
+
+  mSostenutoDown = down;
+
+  // Sostenuto latches only the notes whose keys are down right now
+  for (int v = 0; v < kMaxVoices; v++)
+  {
+    CelestialVoice<T>& voice = *mVoices[v];
+    if (!down)
+      voice.DropHold(CelestialVoice<T>::kHoldSostenuto);
+    else if (voice.GetBusy() && voice.HasHold(CelestialVoice<T>::kHoldKey))
+      voice.AddHold(CelestialVoice<T>::kHoldSostenuto);
+  }
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::ReleaseKey(CelestialVoice<T>& voice)
+{
+  // With the sustain pedal down the voice keeps going until pedal-up
+  if (mSustainDown)
+    voice.AddHold(CelestialVoice<T>::kHoldSustain);
+
+  voice.DropHold(CelestialVoice<T>::kHoldKey);
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::NoteOn(int note, int velocity, int channel)
+{
+  CELESTIAL_TRACE_SCOPE_ARG("NoteOn", note);
+  const double freq = GetNoteFrequency(note);
+
+  if (mGlideMode != kGlidePoly)
+  {
+    // Mono and legato play on the first voice, with the held notes stacked for last-note priority
+    const bool overlapping = mNumHeldNotes > 0 && mVoices[0]->GetBusy();
+    PushHeldNote(note, velocity);
+
+    if (overlapping)
+    {
+      CelestialVoice<T>& voice = *mVoices[0];
+      voice.SetGlideTime(mGlideTimeMs);
+      voice.GlideTo(freq);
+      voice.SetNote(note, velocity);
+      mLastNote = note;
+      mLastNoteFreq = freq;
+
+      // Legato carries the envelope on, mono starts it again from the current phase
+      if (mGlideMode == kGlideMono)
+        voice.Trigger(GetVoiceLevel(velocity), true);
+      return;
+    }
+
+    // Mono always slides in from the last note, legato only between overlapping notes
+    StartVoice(*mVoices[0], note, velocity, channel, freq, mGlideMode == kGlideMono);
+    return;
+  }
+
+  // A note still sounding from the pedals is restarted in place rather than stacked on a second voice
+  for (int v = 0; v < kMaxVoices; v++)
+  {
+    if (mVoices[v]->IsPlayingNote(note))
+    {
+      mVoices[v]->SetNote(note, velocity);
+      mVoices[v]->Trigger(GetVoiceLevel(velocity), true);
+      mLastNote = note;
+      mLastNoteFreq = freq;
+      return;
+    }
+  }
+
+  // Find free voice for note-on. It glides in from the last note still sounding at the end of the
+  // previous block, not from whatever note the voice happened to play before.
+  for (int v = 0; v < mVoiceCount && v < kMaxVoices; v++)
+  {
+    if (!mVoices[v]->GetBusy())
+    {
+      StartVoice(*mVoices[v], note, velocity, channel, freq, mGlideFromFreq > 0.0);
+      break;
+    }
+  }
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::NoteOff(int note)
+{
+  if (mGlideMode != kGlidePoly)
+  {
+    RemoveHeldNote(note);
+
+    CelestialVoice<T>& voice = *mVoices[0];
+    if (!voice.IsPlayingNote(note))
+      return;
+
+    // Fall back to the most recent note still held, without retriggering
+    if (mNumHeldNotes > 0)
+    {
+      voice.GlideTo(GetNoteFrequency(mHeldNotes[mNumHeldNotes - 1]));
+      voice.SetNote(mHeldNotes[mNumHeldNotes - 1], mHeldVelocities[mNumHeldNotes - 1]);
+    }
+    else
+    {
+      ReleaseKey(voice);
+    }
+    return;
+  }
+
+  // Release only voices playing this specific note, or hand them over to the pedals
+  for (int v = 0; v < kMaxVoices; v++)
+  {
+    if (mVoices[v]->IsPlayingNote(note))
+    {
+      ReleaseKey(*mVoices[v]);
+    }
+  }
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::StartVoice(CelestialVoice<T>& voice, int note, int velocity, int channel, double freq, bool glide)
+{
+  // Set voice parameters
+  // Mono has a single voice, so its own pitch already is the last note
+  voice.SetGlideTime(glide ? mGlideTimeMs : 0.0);
+  voice.GlideTo(freq, mGlideMode == kGlidePoly ? mGlideFromFreq : 0.0);
+  mLastNote = note;
+  mLastNoteFreq = freq;
+  voice.SetWaveform(mWaveform);
+  voice.SetFilterCutoff(mFilterCutoff);
+  voice.SetFilterResonance(mFilterResonance);
+  voice.SetAttack(mAttack);
+  voice.SetDecay(mDecay);
+  voice.SetSustain(mSustain);
+  voice.SetReleaseTime(mRelease);
+  voice.SetNote(note, velocity);
+  voice.SetUnison(mUnisonVoices, mUnisonDetune, mUnisonWidth);
+  voice.SetBus(GetRoutedBus(note, velocity, channel));
+
+  // Scatter successive notes across the stereo field, golden ratio steps never repeat a position
+  mPanSequence = mPanSequence + 0.6180339887;
+  mPanSequence -= std::floor(mPanSequence);
+  voice.SetPan(mStereoSpread * (mPanSequence * 2.0 - 1.0));
+
+  voice.Trigger(GetVoiceLevel(velocity), false);
+}
+
+template <typename T>
+double CelestialSynthDSP<T>::GetNoteFrequency(int note) const
+{
+  // Use pentatonic scale system for frequency calculation
+  // Base frequency is C4 (MIDI 60) = 261.6256 Hz
+  double baseFreq = 261.6256;
+  double freq = mScaleSystem.GetFrequencyForMidiNote(note, baseFreq);
+
+  // Apply timbre shift
+  return freq * std::pow(2.0, mTimbreShift * 0.1);
+}
+
+template <typename T>
+double CelestialSynthDSP<T>::GetVoiceLevel(int velocity) const
+{
+  // Apply velocity scaling with warmth
+  return (velocity / 127.0) * (0.5 + mWarmth * 0.5);
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::PushHeldNote(int note, int velocity)
+{
+  RemoveHeldNote(note);
+
+  // Full stack: forget the oldest note
+  if (mNumHeldNotes == kMaxHeldNotes)
+  {
+    for (int i = 1; i < kMaxHeldNotes; i++)
+    {
+      mHeldNotes[i - 1] = mHeldNotes[i];
+      mHeldVelocities[i - 1] = mHeldVelocities[i];
     }
+    mNumHeldNotes--;
+  }
+
+  mHeldNotes[mNumHeldNotes] = note;
+  mHeldVelocities[mNumHeldNotes] = velocity;
+  mNumHeldNotes++;
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::RemoveHeldNote(int note)
+{
+  int n = 0;
+  for (int i = 0; i < mNumHeldNotes; i++)
+  {
+    if (mHeldNotes[i] != note)
+    {
+      mHeldNotes[n] = mHeldNotes[i];
+      mHeldVelocities[n] = mHeldVelocities[i];
+      n++;
+    }
+  }
+  mNumHeldNotes = n;
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::EndStateChange()
+{
+  mStateSerial.fetch_add(1, std::memory_order_release);
+  mStateChangesInFlight.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::SetNoteSplit(int idx, int note)
+{
+  if (idx < 0 || idx >= kMaxBuses - 1)
+    return;
+
+  mPendingNoteSplits[idx].store(note, std::memory_order_relaxed);
+  mStateSerial.fetch_add(1, std::memory_order_release);
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::SetCustomTuning(const double* ratios)
+{
+  if (ratios)
+  {
+    for (int d = 0; d < PentatonicScaleSystem::kNumDegrees; d++)
+      mPendingRatios[d].store(ratios[d], std::memory_order_relaxed);
   }
+  mPendingCustomTuning.store(ratios != nullptr, std::memory_order_relaxed);
+  mStateSerial.fetch_add(1, std::memory_order_release);
 }
 
-void CelestialSynthDSP::Reset(double sampleRate, int blockSize)
+template <typename T>
+bool CelestialSynthDSP<T>::GetCustomTuning(double* ratios) const
+{
+  for (int d = 0; d < PentatonicScaleSystem::kNumDegrees; d++)
+    ratios[d] = mPendingRatios[d].load(std::memory_order_relaxed);
+  return mPendingCustomTuning.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::ApplyPendingState()
+{
+  // Wait out a change that is still being written, it is picked up whole on a later block
+  if (mStateChangesInFlight.load(std::memory_order_acquire) != 0)
+    return;
+
+  const unsigned serial = mStateSerial.load(std::memory_order_acquire);
+  if (serial == mAppliedStateSerial)
+    return;
+
+  mAppliedStateSerial = serial;
+
+  for (int i = 0; i < kMaxBuses - 1; i++)
+    mNoteSplits[i] = mPendingNoteSplits[i].load(std::memory_order_relaxed);
+
+  double ratios[PentatonicScaleSystem::kNumDegrees];
+  const bool custom = GetCustomTuning(ratios);
+  mScaleSystem.SetCustomRatios(custom ? ratios : nullptr);
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::SetGravity(double value)
+{
+  mGravity = value;
+  // Squared so the low end of the knob gives fine control over short glides
+  mGlideTimeMs = value * value * kMaxGlideMs;
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::SetGlideMode(int mode)
+{
+  if (mode >= 0 && mode < kNumGlideModes && mode != mGlideMode)
+  {
+    mGlideMode = (EGlideMode)mode;
+    mNumHeldNotes = 0;
+  }
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::Reset(double sampleRate, int blockSize, int nOutputs)
 {
   mSampleRate = sampleRate;
+  mLoad.SetSampleRate(sampleRate);
 
   // Initialize all voices
   for (int v = 0; v < kMaxVoices; v++)
@@ -283,13 +1153,176 @@ void CelestialSynthDSP::Reset(double sampleRate, int blockSize)
     mVoices[v]->SetSampleRate(sampleRate);
   }
 
-  // Clear delay buffers
-  std::memset(mDelayBufferL, 0, sizeof(mDelayBufferL));
-  std::memset(mDelayBufferR, 0, sizeof(mDelayBufferR));
-  mDelayWritePos = 0;
+  mMotionLFO.SetSampleRate(sampleRate);
+  mMotionLFO.Reset();
+  mLastNote = -1;
+  mLastNoteFreq = 0.0;
+  mGlideFromFreq = 0.0;
+
+  // Only the buses the host has connected get delay lines, reverb memory and a convolution engine.
+  // The others are released, and their voices play through the main bus until the next Reset.
+  // The lock keeps a load finishing on the worker from posting to buses while they are released,
+  // or from being overwritten here by the IR it replaces.
+  std::lock_guard<std::mutex> lock(mImpulseMutex);
+  mImpulseSampleRate = sampleRate;
+  const int nBuses = std::clamp((nOutputs + 1) / 2, 1, (int)kMaxBuses);
+  mAllocatedBuses.store(nBuses, std::memory_order_relaxed);
+
+  for (int b = 0; b < kMaxBuses; b++)
+  {
+    Bus& bus = mBuses[b];
+    if (b >= nBuses)
+    {
+      std::vector<T>().swap(bus.delayL);
+      std::vector<T>().swap(bus.delayR);
+      bus.reverb.Release();
+      bus.convolution.Release();
+      bus.connected = false;
+      continue;
+    }
+
+    // Clear delay buffers
+    bus.delayL.assign(kMaxDelayBufferSize, T(0));
+    bus.delayR.assign(kMaxDelayBufferSize, T(0));
+    bus.delayWritePos = 0;
+
+    // Everything has just been cleared, so there is no tail to wait for
+    bus.samplesSinceVoices = GetDelayTailSamples() + kFilterTailSamples + 1;
+    bus.silent = true;
+
+    bus.eq.SetSampleRate(sampleRate);
+    bus.eq.Reset();
+    bus.width.Reset();
+    bus.saturator.Reset();
+    bus.reverb.Reset(sampleRate);
+    bus.convolution.Reset(sampleRate);
+    // A bus that was released before picks the IR up again
+    if (bus.convolution.GetImpulse() != mImpulse)
+      bus.convolution.LoadImpulse(mImpulse);
+  }
+
+  mPublishedTailSamples.store(GetTailSamples(), std::memory_order_relaxed);
 }
 
-void CelestialSynthDSP::SetWaveform(int wf)
+template <typename T>
+int CelestialSynthDSP<T>::GetDelayTailSamples() const
+{
+  if (mDelayMix <= 0.01)
+    return 0;
+
+  const int delaySamples = std::min((int)((mDelayTime / 1000.0) * mSampleRate), kMaxDelayBufferSize - 1);
+  // The wet tap is mixed back into what gets written as well as fed back, so each trip round the
+  // line is scaled by mix + feedback, not by the feedback alone
+  const double loopGain = std::min(0.999, std::fabs(mDelayMix) + std::fabs(mDelayFeedback));
+
+  // Echoes until the loop has taken them below -100dB
+  const int repeats = loopGain > 1e-5 ? (int)std::ceil(std::log(1e-5) / std::log(loopGain)) : 1;
+  return (repeats + 1) * std::max(delaySamples, 1);
+}
+
+template <typename T>
+int CelestialSynthDSP<T>::GetTailSamples() const
+{
+  return GetTailSamples(mBuses[0].convolution.GetTailSamples());
+}
+
+template <typename T>
+int CelestialSynthDSP<T>::GetTailSamples(int convolutionLength) const
+{
+  // Delay, reverb and convolution are in series, so their tails add up. Every bus has the same settings.
+  const int reverbTail = mReverbMix * mSpace > 0.0 ? mBuses[0].reverb.GetTailSamples() : 0;
+  const int convolutionTail = mConvolutionMix > 0.0 ? convolutionLength : 0;
+  return GetDelayTailSamples() + kFilterTailSamples + reverbTail + convolutionTail;
+}
+
+template <typename T>
+bool CelestialSynthDSP<T>::LoadImpulseResponse(const char* wavPath, uint64_t expectedHash)
+{
+  auto ir = ImpulseResponse::FromWavFileShared(wavPath, expectedHash);
+  if (!ir)
+    return false;
+
+  // The transformed IR is cached, so the buses share one copy
+  LoadImpulseResponse(std::move(ir));
+  return true;
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::LoadImpulseResponse(std::shared_ptr<const ImpulseResponse> ir)
+{
+  std::lock_guard<std::mutex> lock(mImpulseMutex);
+  mImpulseSerial++;
+  PostImpulseResponse(std::move(ir));
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::LoadImpulseResponseAsync(const char* wavPath, uint64_t expectedHash)
+{
+  const std::string path = wavPath ? wavPath : "";
+  unsigned serial;
+  {
+    std::lock_guard<std::mutex> lock(mImpulseMutex);
+    serial = ++mImpulseSerial;
+    mImpulsePath = path;
+    mImpulseHash = expectedHash;
+  }
+
+  ConvolutionWorker::Get().Load(this, [this, path, expectedHash, serial]() {
+    auto ir = ImpulseResponse::FromWavFileShared(path.c_str(), expectedHash);
+    double sampleRate;
+    {
+      std::lock_guard<std::mutex> lock(mImpulseMutex);
+      if (serial != mImpulseSerial)
+        return;
+      sampleRate = mImpulseSampleRate;
+    }
+
+    // Transformed outside the lock, the buses then pick it up from the cache. If a Reset changes
+    // the rate in between, each bus transforms it again at the new one.
+    const auto transformed = ConvolutionIR::Get(ir, sampleRate);
+
+    std::lock_guard<std::mutex> lock(mImpulseMutex);
+    if (serial == mImpulseSerial)
+      PostImpulseResponse(std::move(ir));
+  });
+}
+
+// Called with mImpulseMutex held
+template <typename T>
+void CelestialSynthDSP<T>::PostImpulseResponse(std::shared_ptr<const ImpulseResponse> ir)
+{
+  mImpulsePath = ir ? ir->path : std::string();
+  mImpulseHash = ir ? ir->hash : 0;
+  mImpulse = ir;
+  for (int b = 0; b < mAllocatedBuses.load(std::memory_order_relaxed); b++)
+    mBuses[b].convolution.LoadImpulse(ir);
+}
+
+template <typename T>
+uint64_t CelestialSynthDSP<T>::GetImpulseResponseId(std::string& path) const
+{
+  std::lock_guard<std::mutex> lock(mImpulseMutex);
+  path = mImpulsePath;
+  return mImpulseHash;
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::SetSpace(double value)
+{
+  mSpace = value;
+
+  // Bigger space = longer lines, longer tail and a slightly darker room
+  for (Bus& bus : mBuses)
+  {
+    bus.reverb.SetSize(value);
+    bus.reverb.SetDecayTime(0.6 + value * 5.4);
+    bus.reverb.SetDamping(0.2 + value * 0.4);
+    bus.width.SetWidth(1.0 + value * kSpaceMaxWidening);
+  }
+}
+
+template <typename T>
+void CelestialSynthDSP<T>::SetWaveform(int wf)
 {
   if (wf >= 0 && wf < (int)WaveformType::kNumWaveforms)
   {
@@ -297,7 +1330,8 @@ void CelestialSynthDSP::SetWaveform(int wf)
   }
 }
 
-void CelestialSynthDSP::SetScale(int scale)
+template <typename T>
+void CelestialSynthDSP<T>::SetScale(int scale)
 {
   if (scale >= 0 && scale < PentatonicScaleSystem::kNumScales)
   {
@@ -306,14 +1340,21 @@ void CelestialSynthDSP::SetScale(int scale)
 }
 
 // PentatonicScaleSystem implementation
+void PentatonicScaleSystem::SetCustomRatios(const double* ratios)
+{
+  mUseCustomRatios = ratios != nullptr;
+  if (ratios)
+    std::copy(ratios, ratios + kNumDegrees, mCustomRatios);
+}
+
 double PentatonicScaleSystem::GetScaleNote(int noteIndex, double baseFreq) const
 {
   // Map note index to scale degree and octave
   int scaleIndex = noteIndex % 5;
   int octave = noteIndex / 5;
 
-  // Get ratio from current scale
-  double ratio = mScaleRatios[mCurrentScale][scaleIndex];
+  // Get ratio from current scale, or the custom tuning
+  double ratio = GetRatio(scaleIndex);
   double octaveMultiplier = std::pow(2.0, octave);
 
   return baseFreq * ratio * octaveMultiplier;
@@ -335,4 +1376,9 @@ double PentatonicScaleSystem::GetFrequencyForMidiNote(int midiNote, double baseF
 
   // Calculate frequency using scale ratios
   return GetScaleNote(scaleIndex, baseFreq);
-}
\ No newline at end of file
+}
+
+template class CelestialVoice<float>;
+template class CelestialVoice<double>;
+template class CelestialSynthDSP<float>;
+template class CelestialSynthDSP<double>;
@@ -4,6 +4,26 @@
 #include "IPlugMidi.h"
 #include "MidiSynth.h"
 #include "Oscillator.h"
+#include "CelestialSynth_Reverb.h"
+#include "CelestialSynth_Convolver.h"
+#include "CelestialSynth_Saturation.h"
+#include "CelestialSynth_Denormals.h"
+#include "CelestialSynth_VoiceSnapshot.h"
+#include "CelestialSynth_LoadMeter.h"
+#include "CelestialSynth_Trace.h"
+#include "CelestialSynth_RealtimeAudit.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Fuzz builds (see CelestialSynth_Fuzz.h) add checks to the audio path that normal builds leave out
+#ifndef CELESTIAL_FUZZ
+#define CELESTIAL_FUZZ 0
+#endif
 
 using namespace iplug;
 
@@ -25,7 +45,14 @@ public:
     kNumScales
   };
 
+  static constexpr int kNumDegrees = 5;
+
   void SetScale(ScaleType scale) { mCurrentScale = scale; }
+  ScaleType GetScale() const { return mCurrentScale; }
+  // Replaces the selected scale's ratios with kNumDegrees custom ones, nullptr goes back to the scale
+  void SetCustomRatios(const double* ratios);
+  bool HasCustomRatios() const { return mUseCustomRatios; }
+  double GetRatio(int degree) const { return mUseCustomRatios ? mCustomRatios[degree] : mScaleRatios[mCurrentScale][degree]; }
   double GetScaleNote(int noteIndex, double baseFreq) const;
 
   // Convert MIDI note to pentatonic scale index
@@ -36,6 +63,8 @@ public:
 
 private:
   ScaleType mCurrentScale = kJapaneseYo;
+  bool mUseCustomRatios = false;
+  double mCustomRatios[kNumDegrees] = {1.0, 9.0/8.0, 5.0/4.0, 3.0/2.0, 5.0/3.0};
 
   // Just intonation ratios for all 9 scales
   static constexpr double mScaleRatios[kNumScales][5] = {
@@ -96,19 +125,20 @@ enum class WaveformType
 };
 
 // Simple ADSR envelope
+template <typename T>
 class ADSREnvelope
 {
 public:
   void SetSampleRate(double sr) { mSampleRate = sr; }
   void SetAttack(double ms) { mAttackSamples = (ms / 1000.0) * mSampleRate; }
   void SetDecay(double ms) { mDecaySamples = (ms / 1000.0) * mSampleRate; }
-  void SetSustain(double level) { mSustainLevel = level; }
+  void SetSustain(double level) { mSustainLevel = (T)level; }
   void SetRelease(double ms) { mReleaseSamples = (ms / 1000.0) * mSampleRate; }
 
   void Trigger()
   {
     mStage = kAttack;
-    mEnvelopeValue = 0.0;
+    mEnvelopeValue = T(0);
     mSampleCount = 0;
   }
 
@@ -119,27 +149,27 @@ public:
     mSampleCount = 0;
   }
 
-  double Process()
+  T Process()
   {
     switch (mStage)
     {
       case kAttack:
         if (mAttackSamples > 0)
-          mEnvelopeValue = (double)mSampleCount / mAttackSamples;
+          mEnvelopeValue = (T)(mSampleCount / mAttackSamples);
         else
-          mEnvelopeValue = 1.0;
+          mEnvelopeValue = T(1);
 
         if (++mSampleCount >= mAttackSamples)
         {
           mStage = kDecay;
           mSampleCount = 0;
-          mEnvelopeValue = 1.0;
+          mEnvelopeValue = T(1);
         }
         break;
 
       case kDecay:
         if (mDecaySamples > 0)
-          mEnvelopeValue = 1.0 - ((1.0 - mSustainLevel) * ((double)mSampleCount / mDecaySamples));
+          mEnvelopeValue = T(1) - ((T(1) - mSustainLevel) * (T)(mSampleCount / mDecaySamples));
         else
           mEnvelopeValue = mSustainLevel;
 
@@ -156,20 +186,20 @@ public:
 
       case kRelease:
         if (mReleaseSamples > 0)
-          mEnvelopeValue = mReleaseStart * (1.0 - ((double)mSampleCount / mReleaseSamples));
+          mEnvelopeValue = mReleaseStart * (T)(1.0 - (mSampleCount / mReleaseSamples));
         else
-          mEnvelopeValue = 0.0;
+          mEnvelopeValue = T(0);
 
         mSampleCount++;
-        if (mEnvelopeValue <= 0.001)
+        if (mEnvelopeValue <= T(0.001))
         {
-          mEnvelopeValue = 0.0;
+          mEnvelopeValue = T(0);
           mStage = kIdle;
         }
         break;
 
       case kIdle:
-        mEnvelopeValue = 0.0;
+        mEnvelopeValue = T(0);
         break;
     }
 
@@ -177,6 +207,16 @@ public:
   }
 
   bool IsActive() const { return mStage != kIdle; }
+  T GetValue() const { return mEnvelopeValue; }
+
+  // Silence immediately, no release
+  void Reset()
+  {
+    mStage = kIdle;
+    mEnvelopeValue = T(0);
+    mReleaseStart = T(0);
+    mSampleCount = 0;
+  }
 
 private:
   enum Stage { kIdle, kAttack, kDecay, kSustain, kRelease };
@@ -184,14 +224,15 @@ private:
   double mSampleRate = 44100.0;
   double mAttackSamples = 441.0;   // 10ms default
   double mDecaySamples = 2205.0;   // 50ms default
-  double mSustainLevel = 0.7;      // 70% default
+  T mSustainLevel = T(0.7);        // 70% default
   double mReleaseSamples = 8820.0; // 200ms default
-  double mEnvelopeValue = 0.0;
-  double mReleaseStart = 0.0;
+  T mEnvelopeValue = T(0);
+  T mReleaseStart = T(0);
   int mSampleCount = 0;
 };
 
 // Simple lowpass filter
+template <typename T>
 class SimpleLowpassFilter
 {
 public:
@@ -200,27 +241,232 @@ public:
   void SetCutoff(double freq)
   {
     double omega = 2.0 * 3.14159265359 * freq / mSampleRate;
-    mCoeff = std::exp(-omega);
+    mCoeff = (T)std::exp(-omega);
   }
 
   void SetResonance(double res) { mResonance = res; }
 
-  double Process(double input)
+  // Glide the coefficient to a new cutoff over nSamples instead of jumping
+  void RampCutoff(double freq, int nSamples)
   {
-    mZ1 = input * (1.0 - mCoeff) + mZ1 * mCoeff;
+    double omega = 2.0 * 3.14159265359 * freq / mSampleRate;
+    mCoeffStep = ((T)std::exp(-omega) - mCoeff) / nSamples;
+  }
+
+  T Process(T input)
+  {
+    mZ1 = input * (T(1) - mCoeff) + mZ1 * mCoeff;
+    mCoeff += mCoeffStep;
     return mZ1;
   }
 
-  void Reset() { mZ1 = 0.0; }
+  void Reset() { mZ1 = T(0); mCoeffStep = T(0); }
 
 private:
   double mSampleRate = 44100.0;
-  double mCoeff = 0.99;
+  T mCoeff = T(0.99);
+  T mCoeffStep = T(0);
   double mResonance = 0.0;
-  double mZ1 = 0.0;
+  T mZ1 = T(0);
+};
+
+// Brilliance tilt EQ: a single high shelf with its broadband gain removed, so lows drop as
+// highs rise around the pivot and the overall level stays put. Both channels share one set of
+// coefficients and run side by side as two lanes.
+template <typename T>
+class TiltEQ
+{
+public:
+  void SetSampleRate(double sr)
+  {
+    mSampleRate = sr;
+    mCurrentTilt = -1.0;
+    mSmoothing = 1.0 - std::exp(-kSubBlockFrames / (kSmoothingMs * 0.001 * sr));
+  }
+
+  // 0-1, 0.5 is flat
+  void SetTilt(double tilt) { mTargetTilt = tilt; }
+
+  void Reset()
+  {
+    mCurrentTilt = mTargetTilt;
+    UpdateCoefficients();
+    ClearState();
+  }
+
+  void ProcessBlock(T** io, int nChans, int nFrames)
+  {
+    // Settled at flat. The state was cleared on the way in, so leaving the centre later starts
+    // the filter from silence instead of from old history.
+    if (mFlat && mCurrentTilt == mTargetTilt)
+      return;
+
+    T* left = io[0];
+    T* right = nChans > 1 ? io[1] : io[0];
+
+    alignas(16) T x[2];
+    alignas(16) T y[2];
+    for (int start = 0; start < nFrames; start += kSubBlockFrames)
+    {
+      // Glide towards the target once per sub-block, so the glide time is the same at any host
+      // block size. The filter keeps running through the ramp, flat or not.
+      if (mCurrentTilt != mTargetTilt)
+      {
+        const double delta = mTargetTilt - mCurrentTilt;
+        mCurrentTilt = std::fabs(delta) < 1e-4 ? mTargetTilt : mCurrentTilt + delta * mSmoothing;
+        UpdateCoefficients();
+      }
+
+      const int end = std::min(nFrames, start + kSubBlockFrames);
+      for (int s = start; s < end; s++)
+      {
+        x[0] = left[s];
+        x[1] = right[s];
+        for (int c = 0; c < 2; c++)
+        {
+          y[c] = mB0 * x[c] + mZ1[c];
+          mZ1[c] = mB1 * x[c] - mA1 * y[c] + mZ2[c];
+          mZ2[c] = mB2 * x[c] - mA2 * y[c];
+        }
+        left[s] = y[0];
+        right[s] = y[1];
+      }
+    }
+
+    for (int c = 0; c < 2; c++)
+    {
+      if (std::fabs(mZ1[c]) < T(1e-20)) mZ1[c] = T(0);
+      if (std::fabs(mZ2[c]) < T(1e-20)) mZ2[c] = T(0);
+    }
+
+    if (mFlat && mCurrentTilt == mTargetTilt)
+      ClearState();
+  }
+
+private:
+  void UpdateCoefficients()
+  {
+    // RBJ high shelf, slope 1, +/-6dB at the extremes of the tilt
+    const double dB = (mCurrentTilt - 0.5) * 24.0;
+    mFlat = std::fabs(dB) < 0.01;
+
+    const double A = std::pow(10.0, dB / 40.0);
+    const double w0 = 2.0 * 3.14159265359 * kPivotHz / mSampleRate;
+    const double cosw = std::cos(w0);
+    const double alpha = std::sin(w0) * 0.5 * std::sqrt(2.0);
+    const double sqrtA2alpha = 2.0 * std::sqrt(A) * alpha;
+
+    const double a0 = (A + 1.0) - (A - 1.0) * cosw + sqrtA2alpha;
+    const double norm = 1.0 / (a0 * A); // 1/A removes the broadband gain to make it a tilt
+
+    mB0 = (T)(A * ((A + 1.0) + (A - 1.0) * cosw + sqrtA2alpha) * norm);
+    mB1 = (T)(-2.0 * A * ((A - 1.0) + (A + 1.0) * cosw) * norm);
+    mB2 = (T)(A * ((A + 1.0) + (A - 1.0) * cosw - sqrtA2alpha) * norm);
+    mA1 = (T)(2.0 * ((A - 1.0) - (A + 1.0) * cosw) / a0);
+    mA2 = (T)(((A + 1.0) - (A - 1.0) * cosw - sqrtA2alpha) / a0);
+  }
+
+  void ClearState()
+  {
+    for (int c = 0; c < 2; c++)
+      mZ1[c] = mZ2[c] = T(0);
+  }
+
+  static constexpr double kPivotHz = 2000.0;
+  static constexpr int kSubBlockFrames = 16;  // coefficients are redesigned at most this often
+  static constexpr double kSmoothingMs = 10.0; // time constant of the Brilliance glide
+
+  double mSampleRate = 44100.0;
+  double mSmoothing = 1.0 - std::exp(-kSubBlockFrames / (kSmoothingMs * 0.001 * 44100.0));
+  double mTargetTilt = 0.5;
+  double mCurrentTilt = 0.5;
+  bool mFlat = true;
+  T mB0 = T(1), mB1 = T(0), mB2 = T(0), mA1 = T(0), mA2 = T(0);
+  alignas(16) T mZ1[2] = {};
+  alignas(16) T mZ2[2] = {};
+};
+
+// Mid/side width: the side signal is scaled and the mid left alone, so the image widens
+// around the centre instead of leaning to one side. Width glides linearly across each block.
+template <typename T>
+class StereoWidth
+{
+public:
+  // 0 = mono, 1 = unchanged, above 1 wider
+  void SetWidth(double width) { mTargetWidth = (T)std::max(0.0, width); }
+
+  void Reset() { mWidth = mTargetWidth; }
+
+  void ProcessBlock(T** io, int nFrames)
+  {
+    if (mWidth == T(1) && mTargetWidth == T(1))
+      return;
+
+    T* left = io[0];
+    T* right = io[1];
+    const T step = (mTargetWidth - mWidth) / nFrames;
+    T width = mWidth;
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      width += step;
+      const T mid = (left[s] + right[s]) * T(0.5);
+      const T side = (left[s] - right[s]) * T(0.5) * width;
+      left[s] = mid + side;
+      right[s] = mid - side;
+    }
+
+    mWidth = mTargetWidth;
+  }
+
+private:
+  T mWidth = T(1);
+  T mTargetWidth = T(1);
+};
+
+// Motion LFOs, evaluated once per control block
+// Three sines at the prime rates the world-instruments synth uses for FM between partials.
+// Phases are kept wrapped to [0, 1) so the output doesn't drift however long the session runs.
+class MotionLFO
+{
+public:
+  static constexpr int kNumLFOs = 3;
+
+  void SetSampleRate(double sr) { mSampleRate = sr; }
+
+  void Reset()
+  {
+    for (int i = 0; i < kNumLFOs; i++)
+    {
+      mPhase[i] = i / (double)kNumLFOs;
+      mValue[i] = 0.0;
+    }
+  }
+
+  // Advance by nSamples and latch the value for the end of that span
+  void Advance(int nSamples)
+  {
+    for (int i = 0; i < kNumLFOs; i++)
+    {
+      mPhase[i] += kRatesHz[i] * nSamples / mSampleRate;
+      mPhase[i] -= std::floor(mPhase[i]);
+      mValue[i] = std::sin(2.0 * 3.14159265359 * mPhase[i]);
+    }
+  }
+
+  double GetValue(int idx) const { return mValue[idx % kNumLFOs]; }
+
+private:
+  static constexpr double kRatesHz[kNumLFOs] = {7.0, 11.0, 13.0};
+
+  double mSampleRate = 44100.0;
+  double mPhase[kNumLFOs] = {};
+  double mValue[kNumLFOs] = {};
 };
 
 // Voice class
+// T is the processing type for the signal path; phase accumulation always stays in double.
+template <typename T>
 class CelestialVoice : public SynthVoice
 {
 public:
@@ -229,13 +475,45 @@ public:
   bool GetBusy() const override;
   void Trigger(double level, bool isRetrigger) override;
   void Release() override;
+  // Stop dead and clear oscillator, filter and envelope state
+  void Kill();
+
+  // What is keeping the note on. Trigger sets kHoldKey, and the voice releases when the last hold is dropped.
+  enum EHold
+  {
+    kHoldKey = 1,
+    kHoldSustain = 2,
+    kHoldSostenuto = 4
+  };
+  void AddHold(int hold) { mHolds |= hold; }
+  void DropHold(int hold);
+  bool HasHold(int hold) const { return (mHolds & hold) != 0; }
   void ProcessSamplesAccumulating(sample** inputs, sample** outputs, int nInputs, int nOutputs, int startIdx, int nSamples) override;
+  // Adds this voice into outputs in the processing type, used by CelestialSynthDSP
+  void ProcessAccumulating(T** outputs, int nOutputs, int startIdx, int nSamples);
 
   void SetFrequency(double freq);
   void SetSampleRate(double sr);
   void SetWaveform(WaveformType wf) { mWaveform = wf; }
-  void SetFilterCutoff(double cutoff) { mFilter.SetCutoff(cutoff); }
-  void SetFilterResonance(double res) { mFilter.SetResonance(res); }
+  void SetFilterCutoff(double cutoff) { mFilterCutoff = cutoff; mFilter.SetCutoff(cutoff); mFilterR.SetCutoff(cutoff); }
+
+  // Pitch and cutoff multipliers to reach by the end of the next nSamples, ramped per sample
+  void SetModulation(double pitchMult, double cutoffMult, int nSamples);
+
+  // Glide: time constant of the exponential pitch approach, 0 jumps straight to the new note
+  void SetGlideTime(double ms) { mGlideTimeMs = ms; }
+  // Retune to freq, gliding from wherever the pitch is now if a glide time is set,
+  // or from fromFreq instead when that is given
+  void GlideTo(double freq, double fromFreq = 0.0);
+  void SetFilterResonance(double res) { mFilter.SetResonance(res); mFilterR.SetResonance(res); }
+  // -1 hard left to 1 hard right, turned into the L/R gains used for every sample of the note
+  void SetPan(double pan);
+
+  // Unison stack: count sub-oscillators (1 = off) spread over +/-detuneCents and fanned out over
+  // +/-width of the stereo field. Takes effect on the next trigger.
+  static constexpr int kMaxUnison = 8;
+  void SetUnison(int count, double detuneCents, double width);
+  void SetRandomSeed(uint32_t seed) { mRandomState = seed ? seed : 1; }
 
   // ADSR control
   void SetAttack(double ms) { mEnvelope.SetAttack(ms); }
@@ -246,14 +524,22 @@ public:
   // Add note tracking
   void SetNote(int note, int velocity) { mNote = note; mVelocity = velocity; }
   int GetNote() const { return mNote; }
+  double GetEnvelopeLevel() const { return (double)mEnvelope.GetValue(); }
+  double GetPan() const { return mPan; }
   bool IsPlayingNote(int note) const { return mNote == note && GetBusy(); }
 
+  // Output bus, assigned at note-on by the DSP's routing
+  void SetBus(int bus) { mBus = bus; }
+  int GetBus() const { return mBus; }
+
 private:
-  double GenerateWaveform();
+  T GenerateWaveform();
+  void RenderUnison(T& left, T& right);
 
-  FastSinOscillator<sample> mOsc;
-  SimpleLowpassFilter mFilter;
-  ADSREnvelope mEnvelope;
+  FastSinOscillator<T> mOsc;
+  SimpleLowpassFilter<T> mFilter;
+  SimpleLowpassFilter<T> mFilterR; // right side of the unison stack
+  ADSREnvelope<T> mEnvelope;
   WaveformType mWaveform = WaveformType::kSine;
 
   double mFrequency = 440.0;
@@ -261,28 +547,86 @@ private:
   double mPhaseIncrement = 0.0;
   double mSampleRate = 44100.0;
 
+  // Motion modulation, interpolated across each control block
+  double mBaseIncrement = 0.0;
+  double mPitchMod = 1.0;
+  double mPitchModStep = 0.0;
+  double mFilterCutoff = 20000.0;
+
+  // Glide, octaves still to go to the target pitch
+  double mGlideOctaves = 0.0;
+  double mGlideTimeMs = 0.0;
+
   double mVoiceGain = 0.0;
+
+  // Stereo placement, output scaling folded in
+  static constexpr double kOutputScale = 0.3;
+  double mPan = 0.0;
+  T mPanGainL = T(kOutputScale);
+  T mPanGainR = T(kOutputScale);
+
+  // Unison lanes. All kMaxUnison lanes always run, unused ones have zero gain, so the lane loops
+  // have a fixed trip count and compile to straight SIMD.
+  int mUnisonCount = 1;
+  alignas(32) double mUnisonPhase[kMaxUnison] = {};
+  alignas(32) double mUnisonRatio[kMaxUnison] = {};
+  alignas(32) T mUnisonGainL[kMaxUnison] = {};
+  alignas(32) T mUnisonGainR[kMaxUnison] = {};
+  uint32_t mRandomState = 1;
+
   int mNote = -1;
   int mVelocity = 0;
+  int mBus = 0;
+  int mHolds = 0;
 };
 
-// Main DSP class  
+// Main DSP class
+// Instantiated for float and double in CelestialSynth_DSP.cpp, the plugin uses CelestialSynthDSP<sample>
+template <typename T>
 class CelestialSynthDSP
 {
 public:
+  // Each stereo pair of outputs is a bus with its own master chain
+  static constexpr int kMaxBuses = 4;
+
+  enum EGlideMode
+  {
+    kGlidePoly = 0,  // each new voice glides in from the last note still sounding
+    kGlideMono,      // one voice, always glides, envelope restarts on each note
+    kGlideLegato,    // one voice, glides only between overlapping notes without restarting the envelope
+    kNumGlideModes
+  };
+
+  enum ERouting
+  {
+    kRoutingMain = 0,     // everything on the first bus
+    kRoutingNoteRange,    // keyboard zones split at the note splits
+    kRoutingMidiChannel,  // channel modulo the bus count
+    kRoutingVelocity,     // soft to loud across the buses
+    kNumRoutings
+  };
+
   CelestialSynthDSP();
+  ~CelestialSynthDSP() { ConvolutionWorker::Get().CancelLoads(this); }
   
-  void ProcessBlock(sample** inputs, sample** outputs, int nInputs, int nOutputs, int nFrames, double qnPos = 0.0);
-  void Reset(double sampleRate, int blockSize);
+  void ProcessBlock(T** inputs, T** outputs, int nInputs, int nOutputs, int nFrames, double qnPos = 0.0);
+  // nOutputs is the number of output channels the host has connected, buses beyond it aren't allocated
+  void Reset(double sampleRate, int blockSize, int nOutputs = 2 * kMaxBuses);
   void ProcessMidiMsg(const IMidiMsg& msg);
   void SetScale(int scale);
   
   // Five Sacred Controls
-  void SetBrilliance(double value) { mBrilliance = value; }
+  void SetBrilliance(double value) { mBrilliance = value; for (Bus& bus : mBuses) bus.eq.SetTilt(value); }
   void SetMotion(double value) { mMotion = value; }
-  void SetSpace(double value) { mSpace = value; }
-  void SetWarmth(double value) { mWarmth = value; }
-  void SetPurity(double value) { mPurity = value; }
+  // Glide time, see EGlideMode for how it's applied
+  void SetGravity(double value);
+  void SetGlideMode(int mode);
+  void SetSpace(double value);
+  void SetWarmth(double value) { mWarmth = value; for (Bus& bus : mBuses) bus.saturator.SetWarmth(value); }
+  void SetPurity(double value) { mPurity = value; for (Bus& bus : mBuses) bus.saturator.SetPurity(value); }
+
+  // Oversampling around the Warmth/Purity waveshaper, see Saturator::EOversampling
+  void SetOversampling(int mode) { for (Bus& bus : mBuses) bus.saturator.SetOversampling(mode); }
   
   // Synthesis Controls
   void SetWaveform(int wf);
@@ -295,18 +639,94 @@ public:
 
   // Effects
   void SetReverbMix(double value) { mReverbMix = value; }
-  void SetDelayTime(double value) { mDelayTime = value; }
+  // Clamped to what the delay line holds, a negative or non-finite time would read outside it
+  void SetDelayTime(double value) { mDelayTime = std::isfinite(value) ? std::clamp(value, 0.0, kMaxDelayTimeMs) : 0.0; }
   void SetDelayFeedback(double value) { mDelayFeedback = value; }
   void SetDelayMix(double value) { mDelayMix = value; }
 
+  // Convolution - IR loading and transformation run on the calling thread, never call from the audio thread
+  // With expectedHash set, an already loaded copy of the file is only reused if it still matches
+  bool LoadImpulseResponse(const char* wavPath, uint64_t expectedHash = 0);
+  void LoadImpulseResponse(std::shared_ptr<const ImpulseResponse> ir);
+  // Same, but read and transformed on the convolution loader thread, so it returns straight away.
+  // A file that can't be read clears the IR. A later load or clear supersedes one still running.
+  void LoadImpulseResponseAsync(const char* wavPath, uint64_t expectedHash = 0);
+  void ClearImpulseResponse() { LoadImpulseResponse(std::shared_ptr<const ImpulseResponse>()); }
+  std::shared_ptr<const ImpulseResponse> GetImpulseResponse() const { return mBuses[0].convolution.GetImpulse(); }
+  // The IR a saved session should name: the one still loading if there is one, else the one loaded.
+  // Returns its hash, 0 for none. Not on the audio thread.
+  uint64_t GetImpulseResponseId(std::string& path) const;
+  void SetConvolutionMix(double value) { mConvolutionMix = value; }
+  // Audio thread, before ProcessBlock. Offline renders compute the convolution tail inline.
+  void SetRenderingOffline(bool offline) { for (Bus& bus : mBuses) bus.convolution.SetRenderingOffline(offline); }
+
   // Additional Controls
   void SetTimbreShift(double value) { mTimbreShift = value; }
+  // Stored with the session, the voices don't use it yet
+  void SetHarmonicBlend(double value) { mHarmonicBlend = value; }
   void SetVoiceCount(int count) { mVoiceCount = count; }
   void SetGain(double gain) { mGain = gain; }
+  // 0-1, how far apart successive notes are placed in the stereo field
+  void SetStereoSpread(double value) { mStereoSpread = value; }
+
+  // Unison, applied at note-on
+  void SetUnisonVoices(int count) { mUnisonVoices = count; }
+  void SetUnisonDetune(double cents) { mUnisonDetune = cents; }
+  void SetUnisonWidth(double value) { mUnisonWidth = value; }
+
+  // Output routing, see ERouting. The bus is picked at note-on.
+  void SetRouting(int mode) { if (mode >= 0 && mode < kNumRoutings) mRouting = (ERouting)mode; }
+  // Stored with the session, notes and pitch bend are handled the same either way for now
+  void SetMPEEnabled(bool enabled) { mMPEEnabled = enabled; }
+  // Session state that isn't a parameter: note splits and custom tuning. The setters can be called from any
+  // thread; bracket several with Begin/EndStateChange and the audio thread picks them up together at the
+  // start of a block, so a restore is never heard half applied. The getters return what was last set.
+  void BeginStateChange() { mStateChangesInFlight.fetch_add(1, std::memory_order_acq_rel); }
+  void EndStateChange();
+  // Lowest note of bus idx + 1 when routing by note range
+  void SetNoteSplit(int idx, int note);
+  int GetNoteSplit(int idx) const { return mPendingNoteSplits[idx].load(std::memory_order_relaxed); }
+  // PentatonicScaleSystem::kNumDegrees ratios replacing the scale's own, or nullptr to use the scale
+  void SetCustomTuning(const double* ratios);
+  bool GetCustomTuning(double* ratios) const;
+  // An unconnected bus does no processing at all, its voices play through the first bus instead
+  void SetBusConnected(int bus, bool connected) { if (bus > 0 && bus < kMaxBuses) mBusConnected[bus] = connected; }
+
+  // Tail tracking
+  // True when the last block was skipped as silence: no voices, and every effect tail below -100dB
+  bool IsOutputSilent() const;
+  // Longest time the output can keep ringing after the last voice stops, for the host's tail size.
+  // Not while ProcessBlock may run, the UI thread reads GetPublishedTailSamples instead.
+  int GetTailSamples() const;
+  // Any thread. The tail length as of the last block processed, or of the last Reset.
+  int GetPublishedTailSamples() const { return mPublishedTailSamples.load(std::memory_order_relaxed); }
+
+  // Number of blocks where a NaN/Inf was caught and the offending state reset. Safe from any thread.
+  int GetNonFiniteResetCount() const { return mNonFiniteResets.load(std::memory_order_relaxed); }
+
+  // Sounding voices for the UI, published once per block while enabled (i.e. while an editor is open)
+  void SetVoiceSnapshotEnabled(bool enabled) { mVoiceSnapshotEnabled.store(enabled, std::memory_order_relaxed); }
+  // UI thread: copies the newest snapshot into dest, false if nothing new was published since the last call
+  bool ReadVoiceSnapshot(CelestialVoiceSnapshot& dest);
+
+  // Output meter for the main bus, gathered in the final pass over each block (the NaN check), so it
+  // costs no extra pass. Audio thread: once windowFrames have gone by, fills in the peak and RMS
+  // since the last reading and returns true.
+  struct MeterReading
+  {
+    float peak[2];
+    float rms[2];
+  };
+  bool TakeMeterReading(int windowFrames, MeterReading& reading);
+
+  // DSP load per stage, always measured. Call from the thread that runs ProcessBlock (the audio thread,
+  // or whatever drives an offline render): once windowFrames have gone by, fills in reading and returns true.
+  bool TakeLoadReading(int windowFrames, CelestialLoadReading& reading) { return mLoad.TakeReading(windowFrames, reading); }
 
 private:
-  static const int kMaxVoices = 16;
-  std::unique_ptr<CelestialVoice> mVoices[kMaxVoices];
+  static constexpr int kMaxVoices = 16;
+  static_assert(kMaxVoices <= CelestialVoiceSnapshot::kMaxVoices, "Voice snapshot too small");
+  std::unique_ptr<CelestialVoice<T>> mVoices[kMaxVoices];
   PentatonicScaleSystem mScaleSystem;
   double mSampleRate = 44100.0;
 
@@ -332,17 +752,134 @@ private:
   double mDelayFeedback = 0.3;
   double mDelayMix = 0.2;
 
-  // Simple delay buffer
-  static const int kMaxDelayBufferSize = 88200; // 2 seconds at 44.1kHz
-  double mDelayBufferL[kMaxDelayBufferSize];
-  double mDelayBufferR[kMaxDelayBufferSize];
-  int mDelayWritePos = 0;
+  double mConvolutionMix = 0.5;
+  static constexpr int kMaxDelayBufferSize = 88200; // 2 seconds at 44.1kHz
+  static constexpr double kMaxDelayTimeMs = 2000.0;
+
+  // Master chain for one output bus
+  struct Bus
+  {
+    TiltEQ<T> eq;               // Brilliance
+    StereoWidth<T> width;       // Space
+    Saturator<T> saturator;     // Warmth/Purity
+    std::vector<T> delayL;      // simple delay, kMaxDelayBufferSize each, empty while the bus isn't allocated
+    std::vector<T> delayR;
+    int delayWritePos = 0;
+    FDNReverb<T> reverb;        // Space
+    ConvolutionReverb convolution; // sacred space, after the master chain
+
+    bool connected = true;
+    int samplesSinceVoices = 0;
+    bool silent = true;
+  };
+
+  Bus mBuses[kMaxBuses];
+  std::atomic<int> mAllocatedBuses {1}; // set by Reset from the connected outputs
+
+  // The IR this instance is set to, loaded or still loading
+  void PostImpulseResponse(std::shared_ptr<const ImpulseResponse> ir);
+  mutable std::mutex mImpulseMutex; // guards the rest
+  std::shared_ptr<const ImpulseResponse> mImpulse; // what the buses are set to
+  double mImpulseSampleRate = 44100.0;             // the rate of the last Reset, for the loader
+  std::string mImpulsePath;
+  uint64_t mImpulseHash = 0;
+  unsigned mImpulseSerial = 0; // bumped by every load and clear, an async load that sees it change is dropped
+  bool mBusConnected[kMaxBuses] = {true, true, true, true};
+  ERouting mRouting = kRoutingMain;
+  int mNoteSplits[kMaxBuses - 1] = {48, 60, 72};
+
+  // Written by the state setters, copied into the members above by ApplyPendingState
+  void ApplyPendingState();
+  std::atomic<int> mStateChangesInFlight {0};
+  std::atomic<unsigned> mStateSerial {0};
+  unsigned mAppliedStateSerial = 0;
+  std::atomic<int> mPendingNoteSplits[kMaxBuses - 1];
+  std::atomic<bool> mPendingCustomTuning {false};
+  std::atomic<double> mPendingRatios[PentatonicScaleSystem::kNumDegrees];
+
+  int GetRoutedBus(int note, int velocity, int channel) const;
+
+  // Note handling
+  void NoteOn(int note, int velocity, int channel);
+  void NoteOff(int note);
+  void ReleaseKey(CelestialVoice<T>& voice);
+  void SetSustainPedal(bool down);
+  void SetSostenutoPedal(bool down);
+  void StartVoice(CelestialVoice<T>& voice, int note, int velocity, int channel, double freq, bool glide);
+  double GetNoteFrequency(int note) const;
+  double GetVoiceLevel(int velocity) const;
+
+  // Gravity glide, and the held notes for mono/legato last-note priority
+  void PushHeldNote(int note, int velocity);
+  void RemoveHeldNote(int note);
+  static constexpr double kMaxGlideMs = 600.0; // time constant at Gravity = 1
+  static constexpr int kMaxHeldNotes = 16;
+  double mGravity = 0.5;
+  double mGlideTimeMs = 0.25 * kMaxGlideMs;
+  EGlideMode mGlideMode = kGlidePoly;
+  int mHeldNotes[kMaxHeldNotes] = {};
+  int mHeldVelocities[kMaxHeldNotes] = {};
+  int mNumHeldNotes = 0;
+  int mLastNote = -1;          // last note played, -1 before the first
+  double mLastNoteFreq = 0.0;
+  double mGlideFromFreq = 0.0; // where a poly voice glides in from, the last note if it sounded through the previous block
+
+  // Pedals, CC64 and CC66
+  bool mSustainDown = false;
+  bool mSostenutoDown = false;
+
+  void ProcessBusEffects(Bus& bus, T** io, int nChans, int nFrames);
+
+  // Silence detection
+  int GetDelayTailSamples() const;
+  // Total tail for a convolution IR of convolutionLength samples
+  int GetTailSamples(int convolutionLength) const;
+  static constexpr int kFilterTailSamples = 256; // tilt EQ and oversampling filters ring out well within this
+  std::atomic<int> mPublishedTailSamples {0}; // by the audio thread at the end of each block
+
+  // NaN/Inf recovery
+  static bool IsBlockFinite(T** outputs, int nOutputs, int nFrames);
+  // Per-channel peak and sum of squares, false if any sample was NaN or Inf
+  static bool MeasureBlock(T** outputs, int nOutputs, int nFrames, T* peak, T* sumSquares);
+
+  // Voice snapshot for the UI
+  void PublishVoiceSnapshot();
+  TripleBuffer<CelestialVoiceSnapshot> mVoiceSnapshots;
+  std::atomic<bool> mVoiceSnapshotEnabled {false};
+  static constexpr uint64_t kNoSnapshot = 0;
+  static constexpr float kSnapshotLevelSteps = 64.f;
+  uint64_t mVoiceSnapshotSignature = kNoSnapshot; // of the last one published, an unchanged one isn't sent again
+
+  // Main bus meter, accumulated since the last TakeMeterReading
+  double mMeterPeak[2] = {};
+  double mMeterSumSquares[2] = {};
+  int mMeterFrames = 0;
+
+  CelestialLoadProfiler mLoad;
+
+  void ClearBus(Bus& bus);
+  std::atomic<int> mNonFiniteResets {0};
 
   // Additional parameter values
   double mTimbreShift = 0.0;
+  double mHarmonicBlend = 0.5;
+  bool mMPEEnabled = false;
   int mVoiceCount = 8;
   double mGain = 0.5;
 
-  // Motion phase (was static, now instance variable for multi-instance support)
-  double mMotionPhase = 0.0;
+  // Stereo placement
+  static constexpr double kSpaceMaxWidening = 0.6; // width at Space = 1 is 1 + this
+  double mStereoSpread = 0.5;
+  double mPanSequence = 0.0;
+
+  // Unison
+  int mUnisonVoices = 1;
+  double mUnisonDetune = 15.0; // cents either side
+  double mUnisonWidth = 0.7;
+
+  // Motion LFOs, updated every kControlBlockSize samples
+  static constexpr int kControlBlockSize = 32;
+  static constexpr double kMotionVibratoSemitones = 0.35; // depth at Motion = 1
+  static constexpr double kMotionFilterOctaves = 0.5;
+  MotionLFO mMotionLFO;
 };
\ No newline at end of file
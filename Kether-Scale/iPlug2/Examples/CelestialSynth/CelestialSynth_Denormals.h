@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+  #include <xmmintrin.h>
+  #define CELESTIAL_DENORMALS_SSE 1
+#elif defined(_M_ARM64)
+  #include <intrin.h>
+  #define CELESTIAL_DENORMALS_ARM64_MSVC 1
+#elif defined(__aarch64__)
+  #define CELESTIAL_DENORMALS_ARM64 1
+#elif defined(__arm__) && defined(__ARM_FP)
+  #define CELESTIAL_DENORMALS_ARM32 1
+#endif
+
+// Flushes denormals to zero for the lifetime of the object and restores the previous mode after.
+// x86: MXCSR FTZ (bit 15) and DAZ (bit 6). ARM: FPCR/FPSCR FZ (bit 24). Elsewhere a no-op.
+class ScopedDenormalGuard
+{
+public:
+  ScopedDenormalGuard()
+  {
+#if defined(CELESTIAL_DENORMALS_SSE)
+    mPrevious = _mm_getcsr();
+    _mm_setcsr((unsigned int)mPrevious | 0x8040);
+#elif defined(CELESTIAL_DENORMALS_ARM64_MSVC)
+    mPrevious = (uint64_t)_ReadStatusReg(ARM64_FPCR);
+    _WriteStatusReg(ARM64_FPCR, (__int64)(mPrevious | (1ULL << 24)));
+#elif defined(CELESTIAL_DENORMALS_ARM64)
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    mPrevious = fpcr;
+    fpcr |= (1ULL << 24);
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#elif defined(CELESTIAL_DENORMALS_ARM32)
+    uint32_t fpscr;
+    __asm__ __volatile__("vmrs %0, fpscr" : "=r"(fpscr));
+    mPrevious = fpscr;
+    fpscr |= (1U << 24);
+    __asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+#endif
+  }
+
+  ~ScopedDenormalGuard()
+  {
+#if defined(CELESTIAL_DENORMALS_SSE)
+    _mm_setcsr((unsigned int)mPrevious);
+#elif defined(CELESTIAL_DENORMALS_ARM64_MSVC)
+    _WriteStatusReg(ARM64_FPCR, (__int64)mPrevious);
+#elif defined(CELESTIAL_DENORMALS_ARM64)
+    uint64_t fpcr = mPrevious;
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#elif defined(CELESTIAL_DENORMALS_ARM32)
+    uint32_t fpscr = (uint32_t)mPrevious;
+    __asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+#endif
+  }
+
+  ScopedDenormalGuard(const ScopedDenormalGuard&) = delete;
+  ScopedDenormalGuard& operator=(const ScopedDenormalGuard&) = delete;
+
+private:
+  uint64_t mPrevious = 0;
+};
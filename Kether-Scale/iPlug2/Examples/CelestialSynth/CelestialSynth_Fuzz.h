@@ -0,0 +1,273 @@
+#pragma once
+
+#include "CelestialSynth_DSP.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// MIDI and parameter fuzzing for the DSP core. Not part of the plugin build. The input bytes are read
+// as a stream of operations (MIDI messages, setter calls and blocks to render), so a fuzzer can find
+// both wrong output and inputs that make a block take far longer than usual.
+//
+// libFuzzer:  clang++ -fsanitize=fuzzer,address,undefined -DCELESTIAL_FUZZ=1 -DCELESTIAL_FUZZ_ENTRY
+//             with this header included from one source file, plus CelestialSynth_DSP.cpp
+// AFL++:      the same with afl-clang-fast++ -fsanitize=fuzzer, or define CELESTIAL_FUZZ_MAIN instead
+//             for a main() that runs one input from a file or stdin
+//
+// Build everything with CELESTIAL_FUZZ=1 so the DSP checks its delay line reads too.
+
+struct CelestialFuzzOptions
+{
+  double spikeFactor = 20.0;      // a block over this many times the median cost per frame is a spike
+  double minSpikeMicros = 1000.0; // and it has to be this long, so timer noise on short blocks isn't one
+  int warmupBlocks = 4;           // first blocks touch fresh buffers and fault pages in, never spikes
+  int maxBlocks = 512;            // render at most this many blocks per input
+};
+
+struct CelestialFuzzReport
+{
+  int blocks = 0;
+  int midiMessages = 0;
+  int setterCalls = 0;
+  int nonFiniteBlocks = 0;  // blocks with NaN/Inf in the output
+  int nonFiniteResets = 0;  // NaN/Inf the DSP caught and recovered from, still a bug upstream of it
+  int spikes = 0;
+  double worstSpikeFactor = 0.0; // worst block's cost per frame over the median
+  int worstSpikeBlock = -1;
+
+  bool Failed() const { return nonFiniteBlocks > 0 || nonFiniteResets > 0 || spikes > 0; }
+};
+
+namespace CelestialFuzz
+{
+static constexpr double kSampleRate = 48000.0;
+static constexpr int kMaxBlockSize = 512;
+
+// Reads the input front to back, zeros once it runs out
+class Input
+{
+public:
+  Input(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+  bool Empty() const { return mPos >= mSize; }
+  uint8_t Byte() { return mPos < mSize ? mData[mPos++] : 0; }
+  uint16_t Word() { return (uint16_t)(Byte() | (Byte() << 8)); }
+  double Unit() { return Word() / 65535.0; }
+
+  // Mostly in range, sometimes the edges and values a host should never send
+  double Extreme(double lo, double hi)
+  {
+    switch (Byte() % 8)
+    {
+      case 0: return lo;
+      case 1: return hi;
+      case 2: return -hi * 1e6;
+      case 3: return hi * 1e6;
+      case 4: return std::numeric_limits<double>::quiet_NaN();
+      case 5: return std::numeric_limits<double>::infinity();
+      default: return lo + Unit() * (hi - lo);
+    }
+  }
+
+private:
+  const uint8_t* mData;
+  size_t mSize;
+  size_t mPos = 0;
+};
+
+enum EOp
+{
+  kOpMidi = 0,   // raw status and data bytes, so velocity 0 note-ons and odd channels come up
+  kOpNoteFlood,  // a burst of note-ons
+  kOpSetter,
+  kOpRender,
+  kNumOps
+};
+
+template <typename T>
+void CallSetter(CelestialSynthDSP<T>& dsp, Input& in)
+{
+  // Ranges the plugin can send, except the delay time, voice count and scale, which also get nonsense
+  const uint8_t which = in.Byte() % 22;
+  switch (which)
+  {
+    case 0: dsp.SetBrilliance(in.Unit()); break;
+    case 1: dsp.SetMotion(in.Unit()); break;
+    case 2: dsp.SetSpace(in.Unit()); break;
+    case 3: dsp.SetWarmth(in.Unit()); break;
+    case 4: dsp.SetPurity(in.Unit()); break;
+    case 5: dsp.SetGravity(in.Unit()); break;
+    case 6: dsp.SetGlideMode((int8_t)in.Byte()); break;
+    case 7: dsp.SetScale((int8_t)in.Byte()); break;
+    case 8: dsp.SetWaveform((int8_t)in.Byte()); break;
+    case 9: dsp.SetTimbreShift(2.0 * in.Unit() - 1.0); break;
+    case 10: dsp.SetVoiceCount((int8_t)in.Byte()); break;
+    case 11: dsp.SetGain(in.Unit()); break;
+    case 12: dsp.SetUnisonVoices((int8_t)in.Byte()); break;
+    case 13: dsp.SetUnisonDetune(100.0 * in.Unit()); break;
+    case 14: dsp.SetRouting((int8_t)in.Byte()); break;
+    case 15: dsp.SetDelayTime(in.Extreme(0.0, 2000.0)); break;
+    case 16: dsp.SetDelayMix(in.Unit()); break;
+    case 17: dsp.SetDelayFeedback(0.99 * in.Unit()); break;
+    case 18: dsp.SetReverbMix(in.Unit()); break;
+    case 19: dsp.SetOversampling(in.Byte() % 4); break;
+    case 20: dsp.SetBusConnected(in.Byte() % CelestialSynthDSP<T>::kMaxBuses, in.Byte() & 1); break;
+    case 21: dsp.SetNoteSplit(in.Byte() % 3, in.Byte() % 128); break;
+  }
+}
+
+template <typename T>
+bool IsFinite(T** outputs, int nChans, int nFrames)
+{
+  for (int c = 0; c < nChans; c++)
+  {
+    for (int s = 0; s < nFrames; s++)
+    {
+      if (!std::isfinite(outputs[c][s]))
+        return false;
+    }
+  }
+  return true;
+}
+} // namespace CelestialFuzz
+
+// Runs one input through a fresh instance
+template <typename T>
+CelestialFuzzReport FuzzCelestialDSP(const uint8_t* data, size_t size, const CelestialFuzzOptions& options = {})
+{
+  using namespace CelestialFuzz;
+
+  auto dsp = std::make_unique<CelestialSynthDSP<T>>();
+  dsp->Reset(kSampleRate, kMaxBlockSize);
+
+  constexpr int kChannels = 2 * CelestialSynthDSP<T>::kMaxBuses;
+  std::vector<T> buffers(kChannels * kMaxBlockSize);
+  T* outputs[kChannels];
+  for (int c = 0; c < kChannels; c++)
+    outputs[c] = buffers.data() + c * kMaxBlockSize;
+
+  CelestialFuzzReport report;
+  std::vector<double> nsPerFrame;
+  std::vector<double> blockNs;
+  Input in(data, size);
+
+  while (!in.Empty() && report.blocks < options.maxBlocks)
+  {
+    switch (in.Byte() % kNumOps)
+    {
+      case kOpMidi:
+      {
+        const uint8_t status = in.Byte(), data1 = in.Byte() & 0x7f, data2 = in.Byte() & 0x7f;
+        dsp->ProcessMidiMsg(IMidiMsg(0, status, data1, data2));
+        report.midiMessages++;
+        break;
+      }
+      case kOpNoteFlood:
+      {
+        const int count = in.Byte() % 64;
+        const int channel = in.Byte() % 16;
+        for (int n = 0; n < count; n++)
+        {
+          IMidiMsg msg;
+          msg.MakeNoteOnMsg(in.Byte() & 0x7f, in.Byte() & 0x7f, 0, channel);
+          dsp->ProcessMidiMsg(msg);
+        }
+        report.midiMessages += count;
+        break;
+      }
+      case kOpSetter:
+        CallSetter(*dsp, in);
+        report.setterCalls++;
+        break;
+      case kOpRender:
+      {
+        const int nFrames = 1 + (int)(in.Word() % kMaxBlockSize);
+        const auto start = std::chrono::steady_clock::now();
+        dsp->ProcessBlock(nullptr, outputs, 0, kChannels, nFrames);
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        blockNs.push_back(ns);
+        nsPerFrame.push_back(ns / nFrames);
+        if (!IsFinite(outputs, kChannels, nFrames))
+          report.nonFiniteBlocks++;
+        report.blocks++;
+        break;
+      }
+    }
+  }
+
+  report.nonFiniteResets = dsp->GetNonFiniteResetCount();
+
+  // Spikes against the median of this run, so they don't depend on the machine
+  if (nsPerFrame.size() >= 8)
+  {
+    std::vector<double> sorted = nsPerFrame;
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+    const double median = std::max(1.0, sorted[sorted.size() / 2]);
+
+    for (size_t b = (size_t)std::max(0, options.warmupBlocks); b < nsPerFrame.size(); b++)
+    {
+      const double factor = nsPerFrame[b] / median;
+      if (factor > options.spikeFactor && blockNs[b] > 1000.0 * options.minSpikeMicros)
+        report.spikes++;
+      if (factor > report.worstSpikeFactor)
+      {
+        report.worstSpikeFactor = factor;
+        report.worstSpikeBlock = (int)b;
+      }
+    }
+  }
+
+  return report;
+}
+
+#if defined(CELESTIAL_FUZZ_ENTRY) || defined(CELESTIAL_FUZZ_MAIN)
+// Aborts on a finding, which is how libFuzzer and AFL know to keep the input. Timing depends on the
+// machine and what else runs on it, so spikes only abort with CELESTIAL_FUZZ_SPIKE_ABORT=1 set.
+inline void CelestialFuzzOne(const uint8_t* data, size_t size)
+{
+  const CelestialFuzzReport report = FuzzCelestialDSP<sample>(data, size);
+  const char* spikeAbort = getenv("CELESTIAL_FUZZ_SPIKE_ABORT");
+  const bool spikesFail = report.spikes > 0 && spikeAbort && spikeAbort[0] == '1';
+  if (report.nonFiniteBlocks == 0 && report.nonFiniteResets == 0 && !spikesFail)
+    return;
+
+  fprintf(stderr, "celestial fuzz: %d non-finite blocks, %d NaN/Inf resets, %d spikes (worst %.1fx the median at block %d)\n",
+          report.nonFiniteBlocks, report.nonFiniteResets, report.spikes, report.worstSpikeFactor, report.worstSpikeBlock);
+  abort();
+}
+#endif
+
+#ifdef CELESTIAL_FUZZ_ENTRY
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+  CelestialFuzzOne(data, size);
+  return 0;
+}
+#endif
+
+#ifdef CELESTIAL_FUZZ_MAIN
+int main(int argc, char** argv)
+{
+  FILE* fp = argc > 1 ? fopen(argv[1], "rb") : stdin;
+  if (!fp)
+    return 1;
+
+  std::vector<uint8_t> data;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    data.insert(data.end(), chunk, chunk + n);
+  if (fp != stdin)
+    fclose(fp);
+
+  CelestialFuzzOne(data.data(), data.size());
+  return 0;
+}
+#endif
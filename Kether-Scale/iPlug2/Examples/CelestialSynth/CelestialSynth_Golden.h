@@ -0,0 +1,429 @@
+#pragma once
+
+#include "CelestialSynth_DSP.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Golden audio regression check for the DSP core. Not part of the plugin build - include it from a
+// scratch app or test host. Renders a fixed set of scenarios (every scale, every waveform, each of
+// the Five Sacred Controls at both ends) and compares them with reference renders recorded earlier,
+// so an optimisation can show it didn't change the sound beyond a tolerance. The references live in
+// golden/ next to this header; re-record them only for a change that is meant to alter the sound.
+// The whole set renders in well under a second of CPU.
+//
+// Define CELESTIAL_GOLDEN_MAIN, with this header included from one source file plus
+// CelestialSynth_DSP.cpp, for a main() that runs the check and exits non-zero on a failure.
+// It takes --record and an optional reference directory.
+
+struct CelestialGoldenTolerance
+{
+  double maxAbsError = 1e-3;  // largest sample difference
+  double maxSpectralDB = 0.5; // mean dB difference of the long-term spectra, over bins above -80dB
+  double maxPitchCents = 2.0; // measured pitch against the scale ratios, for the scale scenarios
+};
+
+struct CelestialGoldenResult
+{
+  std::string name;
+  double maxAbsError = 0.0;
+  double spectralDB = 0.0;
+  double pitchCents = 0.0; // worst note, 0 for scenarios without a pitch check
+  bool recorded = false;   // record was set, this render was written as the reference
+  bool missing = false;    // no reference to compare with, a failure unless recording
+  bool passed = true;
+};
+
+struct CelestialGoldenScenario
+{
+  std::string name;
+  int scale = PentatonicScaleSystem::kJapaneseYo;
+  int waveform = (int)WaveformType::kSaw;
+  double sacred[5] = {0.5, 0.3, 0.4, 0.6, 0.8}; // Brilliance, Motion, Space, Warmth, Purity
+  double gravity = 0.5;
+  double delayMix = 0.2;
+  double releaseMs = 200.0;
+  // Plays the scale degrees one at a time and measures each note's pitch, instead of the held chord
+  bool pitchCheck = false;
+};
+
+namespace CelestialGolden
+{
+static constexpr double kSampleRate = 48000.0;
+static constexpr int kBlockSize = 64;
+static constexpr int kChord[] = {48, 55, 60, 64, 67, 72};
+static constexpr double kChordSeconds = 1.0;
+static constexpr double kTailSeconds = 0.5;
+
+// One note per degree. The DSP puts MIDI octave n at 2^n times C4 (see MapMidiNoteToScaleIndex), so
+// octave 1 keeps the fundamentals between 500Hz and 1kHz.
+static constexpr int kPitchNotes[PentatonicScaleSystem::kNumDegrees] = {12, 14, 16, 19, 21};
+static constexpr double kPitchNoteSeconds = 0.5;
+static constexpr double kPitchSettleSeconds = 0.1; // attack out of the way before measuring
+static constexpr int kPitchFFTSize = 16384;
+static constexpr double kBaseFreq = 261.6256;
+
+static constexpr int kSpectrumFFTSize = 2048;
+
+inline std::vector<CelestialGoldenScenario> GetScenarios()
+{
+  static const char* kScaleNames[PentatonicScaleSystem::kNumScales] = {
+    "yo", "gong", "celtic", "slendro", "highland", "mongolian", "egyptian", "native", "nordic"};
+  static const char* kWaveformNames[(int)WaveformType::kNumWaveforms] = {"sine", "saw", "square", "triangle"};
+  static const char* kSacredNames[5] = {"brilliance", "motion", "space", "warmth", "purity"};
+
+  std::vector<CelestialGoldenScenario> scenarios;
+
+  for (int s = 0; s < PentatonicScaleSystem::kNumScales; s++)
+  {
+    // Pure tones, no glide and nothing smearing one note into the next, so the pitch can be measured
+    CelestialGoldenScenario scenario;
+    scenario.name = std::string("scale_") + kScaleNames[s];
+    scenario.scale = s;
+    scenario.waveform = (int)WaveformType::kSine;
+    scenario.sacred[1] = 0.0;
+    scenario.sacred[2] = 0.0;
+    scenario.gravity = 0.0;
+    scenario.delayMix = 0.0;
+    scenario.releaseMs = 5.0;
+    scenario.pitchCheck = true;
+    scenarios.push_back(scenario);
+  }
+
+  for (int w = 0; w < (int)WaveformType::kNumWaveforms; w++)
+  {
+    CelestialGoldenScenario scenario;
+    scenario.name = std::string("waveform_") + kWaveformNames[w];
+    scenario.waveform = w;
+    scenarios.push_back(scenario);
+  }
+
+  for (int c = 0; c < 5; c++)
+  {
+    for (int high = 0; high < 2; high++)
+    {
+      CelestialGoldenScenario scenario;
+      scenario.name = std::string("sacred_") + kSacredNames[c] + (high ? "_max" : "_min");
+      scenario.sacred[c] = high ? 1.0 : 0.0;
+      scenarios.push_back(scenario);
+    }
+  }
+
+  return scenarios;
+}
+
+// Interleaved stereo
+template <typename T>
+std::vector<float> Render(const CelestialGoldenScenario& scenario)
+{
+  auto dsp = std::make_unique<CelestialSynthDSP<T>>();
+  dsp->Reset(kSampleRate, kBlockSize);
+  dsp->SetScale(scenario.scale);
+  dsp->SetWaveform(scenario.waveform);
+  dsp->SetBrilliance(scenario.sacred[0]);
+  dsp->SetMotion(scenario.sacred[1]);
+  dsp->SetSpace(scenario.sacred[2]);
+  dsp->SetWarmth(scenario.sacred[3]);
+  dsp->SetPurity(scenario.sacred[4]);
+  dsp->SetGravity(scenario.gravity);
+  dsp->SetDelayMix(scenario.delayMix);
+  dsp->SetReleaseTime(scenario.releaseMs);
+
+  // Note events as (block, note, on)
+  struct NoteEvent { int block; int note; bool on; };
+  std::vector<NoteEvent> events;
+  int totalBlocks;
+  if (scenario.pitchCheck)
+  {
+    const int noteBlocks = (int)(kPitchNoteSeconds * kSampleRate / kBlockSize);
+    for (int n = 0; n < PentatonicScaleSystem::kNumDegrees; n++)
+    {
+      events.push_back({n * noteBlocks, kPitchNotes[n], true});
+      events.push_back({(n + 1) * noteBlocks - 1, kPitchNotes[n], false});
+    }
+    totalBlocks = PentatonicScaleSystem::kNumDegrees * noteBlocks;
+  }
+  else
+  {
+    const int holdBlocks = (int)(kChordSeconds * kSampleRate / kBlockSize);
+    for (int note : kChord)
+    {
+      events.push_back({0, note, true});
+      events.push_back({holdBlocks, note, false});
+    }
+    totalBlocks = holdBlocks + (int)(kTailSeconds * kSampleRate / kBlockSize);
+  }
+
+  // Played in block order, the chord's note-offs were pushed between its note-ons
+  std::stable_sort(events.begin(), events.end(), [](const NoteEvent& a, const NoteEvent& b) { return a.block < b.block; });
+
+  std::vector<T> left(kBlockSize), right(kBlockSize);
+  T* outputs[2] = {left.data(), right.data()};
+  std::vector<float> rendered;
+  rendered.reserve(2 * totalBlocks * kBlockSize);
+
+  size_t nextEvent = 0;
+  for (int b = 0; b < totalBlocks; b++)
+  {
+    for (; nextEvent < events.size() && events[nextEvent].block == b; nextEvent++)
+    {
+      IMidiMsg msg;
+      if (events[nextEvent].on)
+        msg.MakeNoteOnMsg(events[nextEvent].note, 100, 0);
+      else
+        msg.MakeNoteOffMsg(events[nextEvent].note, 0);
+      dsp->ProcessMidiMsg(msg);
+    }
+
+    dsp->ProcessBlock(nullptr, outputs, 0, 2, kBlockSize);
+
+    for (int s = 0; s < kBlockSize; s++)
+    {
+      rendered.push_back((float)left[s]);
+      rendered.push_back((float)right[s]);
+    }
+  }
+
+  return rendered;
+}
+
+// Hann windowed magnitudes in dB of the left channel from startFrame, size / 2 + 1 bins
+inline void MagnitudeDB(ConvolutionFFT& fft, const std::vector<float>& interleaved, int startFrame, int size, std::vector<float>& db)
+{
+  std::vector<float> re(size), im(size, 0.f);
+  for (int i = 0; i < size; i++)
+  {
+    const float window = (float)(0.5 - 0.5 * std::cos(2.0 * 3.14159265358979 * i / size));
+    re[i] = interleaved[2 * (startFrame + i)] * window;
+  }
+
+  fft.Transform(re.data(), im.data(), false);
+
+  db.resize(size / 2 + 1);
+  for (int k = 0; k <= size / 2; k++)
+    db[k] = 10.f * std::log10(std::max(1e-20f, re[k] * re[k] + im[k] * im[k]));
+}
+
+// Strongest partial of the left channel, refined by a parabola through the peak bin and its neighbours
+inline double MeasurePitch(const std::vector<float>& interleaved, int startFrame)
+{
+  ConvolutionFFT fft;
+  fft.Init(kPitchFFTSize);
+  std::vector<float> db;
+  MagnitudeDB(fft, interleaved, startFrame, kPitchFFTSize, db);
+
+  int peak = 1;
+  for (int k = 2; k < kPitchFFTSize / 2; k++)
+  {
+    if (db[k] > db[peak])
+      peak = k;
+  }
+
+  const double a = db[peak - 1], b = db[peak], c = db[peak + 1];
+  const double offset = 0.5 * (a - c) / (a - 2.0 * b + c);
+  return (peak + offset) * kSampleRate / kPitchFFTSize;
+}
+
+// Worst pitch error in cents over the scale degrees of a pitchCheck render
+inline double MeasureScalePitchCents(const CelestialGoldenScenario& scenario, const std::vector<float>& rendered)
+{
+  PentatonicScaleSystem scale;
+  scale.SetScale((PentatonicScaleSystem::ScaleType)scenario.scale);
+
+  const int noteFrames = (int)(kPitchNoteSeconds * kSampleRate / kBlockSize) * kBlockSize;
+  double worst = 0.0;
+  for (int n = 0; n < PentatonicScaleSystem::kNumDegrees; n++)
+  {
+    const double expected = kBaseFreq * scale.GetRatio(n) * std::pow(2.0, kPitchNotes[n] / 12);
+    const double measured = MeasurePitch(rendered, n * noteFrames + (int)(kPitchSettleSeconds * kSampleRate));
+    worst = std::max(worst, std::fabs(1200.0 * std::log2(measured / expected)));
+  }
+  return worst;
+}
+
+// Mean dB difference between the averaged spectra, over the bins where either is above -80dB
+inline double SpectralDifferenceDB(const std::vector<float>& a, const std::vector<float>& b)
+{
+  ConvolutionFFT fft;
+  fft.Init(kSpectrumFFTSize);
+  const int frames = (int)(std::min(a.size(), b.size()) / 2);
+  const int numBins = kSpectrumFFTSize / 2 + 1;
+
+  std::vector<double> powerA(numBins, 0.0), powerB(numBins, 0.0);
+  std::vector<float> db;
+  for (int start = 0; start + kSpectrumFFTSize <= frames; start += kSpectrumFFTSize / 2)
+  {
+    MagnitudeDB(fft, a, start, kSpectrumFFTSize, db);
+    for (int k = 0; k < numBins; k++)
+      powerA[k] += std::pow(10.0, db[k] / 10.0);
+    MagnitudeDB(fft, b, start, kSpectrumFFTSize, db);
+    for (int k = 0; k < numBins; k++)
+      powerB[k] += std::pow(10.0, db[k] / 10.0);
+  }
+
+  double peak = 1e-30;
+  for (int k = 0; k < numBins; k++)
+    peak = std::max(peak, std::max(powerA[k], powerB[k]));
+
+  double sum = 0.0;
+  int counted = 0;
+  for (int k = 0; k < numBins; k++)
+  {
+    const double dbA = 10.0 * std::log10(std::max(powerA[k], 1e-30) / peak);
+    const double dbB = 10.0 * std::log10(std::max(powerB[k], 1e-30) / peak);
+    if (std::max(dbA, dbB) < -80.0)
+      continue;
+
+    sum += std::fabs(dbA - dbB);
+    counted++;
+  }
+  return counted ? sum / counted : 0.0;
+}
+
+// Reference file: 'CGLD', version, sample rate, frame count, float32 peak, then interleaved stereo int16
+// scaled to the peak, native byte order. 16 bits keep the files committable and put the rounding error
+// (peak / 65536) far below the default tolerance.
+static constexpr uint32_t kFileMagic = 0x444C4743; // "CGLD" little-endian
+static constexpr uint32_t kFileVersion = 2;
+
+inline bool WriteReference(const std::string& path, const std::vector<float>& rendered)
+{
+  float peak = 0.f;
+  for (float x : rendered)
+    peak = std::max(peak, std::fabs(x));
+  const float scale = peak > 0.f ? 32767.f / peak : 0.f;
+
+  std::vector<int16_t> quantized(rendered.size());
+  for (size_t i = 0; i < rendered.size(); i++)
+    quantized[i] = (int16_t)std::lrint(rendered[i] * scale);
+
+  FILE* fp = fopen(path.c_str(), "wb");
+  if (!fp)
+    return false;
+
+  uint32_t header[5] = {kFileMagic, kFileVersion, (uint32_t)kSampleRate, (uint32_t)(rendered.size() / 2)};
+  memcpy(&header[4], &peak, sizeof(peak));
+  bool ok = fwrite(header, sizeof(header), 1, fp) == 1;
+  ok = ok && fwrite(quantized.data(), sizeof(int16_t), quantized.size(), fp) == quantized.size();
+  return fclose(fp) == 0 && ok;
+}
+
+inline bool ReadReference(const std::string& path, std::vector<float>& rendered)
+{
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp)
+    return false;
+
+  uint32_t header[5];
+  bool ok = fread(header, sizeof(header), 1, fp) == 1 && header[0] == kFileMagic && header[1] == kFileVersion
+         && header[2] == (uint32_t)kSampleRate;
+  if (ok)
+  {
+    float peak;
+    memcpy(&peak, &header[4], sizeof(peak));
+
+    std::vector<int16_t> quantized(2 * (size_t)header[3]);
+    ok = fread(quantized.data(), sizeof(int16_t), quantized.size(), fp) == quantized.size();
+
+    rendered.resize(quantized.size());
+    for (size_t i = 0; i < quantized.size(); i++)
+      rendered[i] = quantized[i] * (peak / 32767.f);
+  }
+  fclose(fp);
+  return ok;
+}
+} // namespace CelestialGolden
+
+// Renders every scenario with processing type T and checks it against <referenceDir>/<name>.cgld.
+// A missing or unreadable reference fails the scenario. With record set, every reference is written
+// from this render instead.
+template <typename T>
+std::vector<CelestialGoldenResult> RunCelestialGolden(const char* referenceDir, const CelestialGoldenTolerance& tolerance = {}, bool record = false)
+{
+  std::vector<CelestialGoldenResult> results;
+
+  for (const CelestialGoldenScenario& scenario : CelestialGolden::GetScenarios())
+  {
+    CelestialGoldenResult result;
+    result.name = scenario.name;
+
+    const std::vector<float> rendered = CelestialGolden::Render<T>(scenario);
+
+    if (scenario.pitchCheck)
+    {
+      result.pitchCents = CelestialGolden::MeasureScalePitchCents(scenario, rendered);
+      result.passed = result.pitchCents <= tolerance.maxPitchCents;
+    }
+
+    const std::string path = std::string(referenceDir) + "/" + scenario.name + ".cgld";
+    std::vector<float> reference;
+    if (record)
+    {
+      result.recorded = CelestialGolden::WriteReference(path, rendered);
+      result.passed = result.passed && result.recorded;
+    }
+    else if (!CelestialGolden::ReadReference(path, reference))
+    {
+      result.missing = true;
+      result.passed = false;
+    }
+    else
+    {
+      if (reference.size() != rendered.size())
+      {
+        result.maxAbsError = INFINITY;
+      }
+      else
+      {
+        for (size_t i = 0; i < rendered.size(); i++)
+          result.maxAbsError = std::max(result.maxAbsError, (double)std::fabs(rendered[i] - reference[i]));
+      }
+      result.spectralDB = CelestialGolden::SpectralDifferenceDB(rendered, reference);
+      result.passed = result.passed && result.maxAbsError <= tolerance.maxAbsError && result.spectralDB <= tolerance.maxSpectralDB;
+    }
+
+    results.push_back(result);
+  }
+
+  return results;
+}
+
+#ifdef CELESTIAL_GOLDEN_MAIN
+int main(int argc, char** argv)
+{
+  bool record = false;
+  std::string referenceDir;
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::string(argv[i]) == "--record")
+      record = true;
+    else
+      referenceDir = argv[i];
+  }
+
+  // golden/ next to this header, by the path the compiler was given for it
+  if (referenceDir.empty())
+  {
+    const std::string header = __FILE__;
+    const size_t slash = header.find_last_of("/\\");
+    referenceDir = (slash == std::string::npos ? std::string(".") : header.substr(0, slash)) + "/golden";
+  }
+
+  int failed = 0;
+  for (const CelestialGoldenResult& result : RunCelestialGolden<sample>(referenceDir.c_str(), {}, record))
+  {
+    const char* status = result.missing ? "MISSING" : !result.passed ? "FAILED" : result.recorded ? "recorded" : "ok";
+    printf("%-24s %-8s abs %.2e  spectrum %.3f dB  pitch %.2f cents\n", result.name.c_str(), status, result.maxAbsError,
+           result.spectralDB, result.pitchCents);
+    failed += !result.passed;
+  }
+
+  printf("%d failed, references in %s\n", failed, referenceDir.c_str());
+  return failed ? 1 : 0;
+}
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "IControl.h"
+#include <functional>
+
+using namespace iplug;
+using namespace igraphics;
+
+// Renders drawFunc once into a cached layer and blits it from then on. Used for the static
+// background (panels, title, section labels), which sits under every control and would otherwise
+// be redrawn from scratch whenever a knob or meter above it repaints.
+class CelestialStaticLayerControl : public IControl
+{
+public:
+  using DrawFunc = std::function<void(IGraphics& g, const IRECT& bounds)>;
+
+  CelestialStaticLayerControl(const IRECT& bounds, DrawFunc drawFunc)
+  : IControl(bounds)
+  , mDrawFunc(std::move(drawFunc))
+  {
+    mIgnoreMouse = true;
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    // CheckLayer also fails after a rescale, so the layer is rebuilt at the new resolution
+    if (!g.CheckLayer(mLayer))
+    {
+      g.StartLayer(this, mRECT);
+      mDrawFunc(g, mRECT);
+      mLayer = g.EndLayer();
+    }
+
+    g.DrawLayer(mLayer);
+  }
+
+private:
+  DrawFunc mDrawFunc;
+  ILayerPtr mLayer;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "CelestialSynth_Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+// Time spent in each part of a block, against the real-time deadline for that block
+struct CelestialLoadReading
+{
+  enum EStage
+  {
+    kStageVoices = 0,  // oscillators, filters and envelopes of every sounding voice
+    kStageTone,        // Brilliance tilt EQ and Warmth/Purity saturation
+    kStageDelay,       // master gain and delay
+    kStageSpace,       // stereo width and FDN reverb
+    kStageConvolution, // IR convolution, the head partition only, the tail runs on its worker
+    kStageOther,       // everything else: clearing, routing, silence and NaN checks, the meter
+    kNumStages
+  };
+
+  static const char* GetStageName(int stage)
+  {
+    static const char* kNames[kNumStages] = {"VOICES", "TONE", "DELAY", "SPACE", "CONV", "OTHER"};
+    return stage >= 0 && stage < kNumStages ? kNames[stage] : "";
+  }
+
+  // Fractions of the deadline, so 1 means the audio thread had no time to spare
+  float load = 0.f;      // whole window: time spent / audio time rendered
+  float peakLoad = 0.f;  // worst single block in the window
+  float stageLoad[kNumStages] = {};
+  float averageVoices = 0.f;
+  int maxVoices = 0;
+  int overruns = 0;      // blocks that took longer than their deadline
+  int blocks = 0;
+};
+
+// Always on per-stage timer for the audio thread. Stages are laps: EndStage books the time since the
+// previous lap, so a block costs one clock read per stage boundary and a few adds. In trace builds
+// each lap is also a trace event.
+class CelestialLoadProfiler
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  void SetSampleRate(double sampleRate) { mSampleRate = sampleRate; }
+
+  void BeginBlock()
+  {
+    mBlockStart = mLapStart = Clock::now();
+  }
+
+  // Restarts the lap without booking it, for work that should land in kStageOther
+  void SkipStage() { mLapStart = Clock::now(); }
+
+  void EndStage(int stage)
+  {
+    const Clock::time_point now = Clock::now();
+    mStageNs[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - mLapStart).count();
+    CELESTIAL_TRACE_EVENT(CelestialLoadReading::GetStageName(stage), CelestialTrace::ToNs(mLapStart), CelestialTrace::ToNs(now));
+    mLapStart = now;
+  }
+
+  void EndBlock(int nFrames, int activeVoices)
+  {
+    const int64_t blockNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - mBlockStart).count();
+    const double deadlineNs = nFrames * 1e9 / mSampleRate;
+
+    mBlockNs += blockNs;
+    mFrames += nFrames;
+    mBlocks++;
+    mPeakLoad = std::max(mPeakLoad, deadlineNs > 0.0 ? blockNs / deadlineNs : 0.0);
+    mOverruns += blockNs > deadlineNs;
+    mVoiceSum += activeVoices;
+    mMaxVoices = std::max(mMaxVoices, activeVoices);
+  }
+
+  // Once windowFrames have gone by, fills in reading for the blocks since the last one and returns true
+  bool TakeReading(int windowFrames, CelestialLoadReading& reading)
+  {
+    if (mFrames < windowFrames || mFrames <= 0)
+      return false;
+
+    const double windowNs = mFrames * 1e9 / mSampleRate;
+    int64_t stagesNs = 0;
+    for (int s = 0; s < CelestialLoadReading::kStageOther; s++)
+    {
+      reading.stageLoad[s] = (float)(mStageNs[s] / windowNs);
+      stagesNs += mStageNs[s];
+    }
+    reading.stageLoad[CelestialLoadReading::kStageOther] = (float)(std::max<int64_t>(0, mBlockNs - stagesNs) / windowNs);
+
+    reading.load = (float)(mBlockNs / windowNs);
+    reading.peakLoad = (float)mPeakLoad;
+    reading.averageVoices = (float)mVoiceSum / mBlocks;
+    reading.maxVoices = mMaxVoices;
+    reading.overruns = mOverruns;
+    reading.blocks = mBlocks;
+
+    ClearWindow();
+    return true;
+  }
+
+private:
+  void ClearWindow()
+  {
+    std::fill(mStageNs, mStageNs + CelestialLoadReading::kNumStages, 0);
+    mBlockNs = 0;
+    mFrames = mBlocks = 0;
+    mPeakLoad = 0.0;
+    mOverruns = mVoiceSum = mMaxVoices = 0;
+  }
+
+  double mSampleRate = 44100.0;
+  Clock::time_point mBlockStart, mLapStart;
+
+  // Accumulated since the last reading
+  int64_t mStageNs[CelestialLoadReading::kNumStages] = {};
+  int64_t mBlockNs = 0;
+  int mFrames = 0;
+  int mBlocks = 0;
+  double mPeakLoad = 0.0;
+  int mOverruns = 0;
+  int mVoiceSum = 0;
+  int mMaxVoices = 0;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "IControl.h"
+#include "ISender.h"
+#include "CelestialSynth_LoadMeter.h"
+#include <cstdio>
+
+using namespace iplug;
+using namespace igraphics;
+
+// DSP load against the real-time deadline, then a bar per stage showing its share of the block.
+// Fed by an ISender<1, ..., CelestialLoadReading> from the audio thread.
+class CelestialLoadMeterControl : public IControl
+{
+public:
+  CelestialLoadMeterControl(const IRECT& bounds, const IColor& color, const IColor& warnColor)
+  : IControl(bounds)
+  , mColor(color)
+  , mWarnColor(warnColor)
+  {
+    mIgnoreMouse = true;
+  }
+
+  void OnMsgFromDelegate(int msgTag, int dataSize, const void* pData) override
+  {
+    if (msgTag != ISender<>::kUpdateMessage || dataSize != sizeof(ISenderData<1, CelestialLoadReading>))
+      return;
+
+    mReading = static_cast<const ISenderData<1, CelestialLoadReading>*>(pData)->vals[0];
+    SetDirty(false);
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    g.FillRect(COLOR_BLACK.WithOpacity(0.35f), mRECT);
+
+    const IRECT inner = mRECT.GetPadded(-4.f);
+    const float lineH = 12.f;
+    const IText text(9, COLOR_LIGHT_GRAY, "Roboto-Regular", EAlign::Near, EVAlign::Middle);
+    // Over half the deadline the host has little room left for anything else
+    const IColor& loadColor = (mReading.overruns > 0 || mReading.peakLoad > 0.5f) ? mWarnColor : mColor;
+
+    char str[32];
+    snprintf(str, sizeof(str), "DSP %.0f%%", 100.f * mReading.load);
+    g.DrawText(text.WithFGColor(loadColor), str, IRECT(inner.L, inner.T, inner.R, inner.T + lineH));
+    snprintf(str, sizeof(str), "PEAK %.0f%%", 100.f * mReading.peakLoad);
+    g.DrawText(text.WithFGColor(loadColor), str, IRECT(inner.L, inner.T + lineH, inner.R, inner.T + 2 * lineH));
+    snprintf(str, sizeof(str), "VOICES %.1f/%d", mReading.averageVoices, mReading.maxVoices);
+    g.DrawText(text, str, IRECT(inner.L, inner.T + 2 * lineH, inner.R, inner.T + 3 * lineH));
+
+    float y = inner.T + 3 * lineH + 4.f;
+    for (int s = 0; s < CelestialLoadReading::kNumStages; s++, y += lineH)
+    {
+      const float share = mReading.load > 0.f ? std::clamp(mReading.stageLoad[s] / mReading.load, 0.f, 1.f) : 0.f;
+      const IRECT row(inner.L, y, inner.R, y + lineH - 2.f);
+      g.FillRect(mColor.WithOpacity(0.35f), IRECT(row.L, row.T, row.L + share * row.W(), row.B));
+      g.DrawText(text, CelestialLoadReading::GetStageName(s), row);
+    }
+  }
+
+private:
+  CelestialLoadReading mReading;
+  IColor mColor;
+  IColor mWarnColor;
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+// The parameters that make up a sound. These are what the factory bank sets and what the
+// morph blends; routing, MPE and the morph controls themselves are never morphed.
+enum EPresetSlot
+{
+  // Continuous, ramped
+  kSlotBrilliance = 0,
+  kSlotMotion,
+  kSlotSpace,
+  kSlotWarmth,
+  kSlotPurity,
+  kSlotGravity,
+  kSlotTimbreShift,
+  kSlotHarmonicBlend,
+  kSlotGain,
+  kSlotUnisonDetune,
+  kSlotUnisonWidth,
+
+  // Stepped, switched. Only read at note-on so they never cut a sounding voice.
+  kSlotVoices,
+  kSlotScaleType,
+  kSlotUnisonVoices,
+  kSlotGlideMode,
+
+  kNumPresetSlots
+};
+
+static constexpr int kFirstSteppedSlot = kSlotVoices;
+
+struct CelestialPreset
+{
+  const char* name;
+  float values[kNumPresetSlots];
+};
+
+// Brilliance, Motion, Space, Warmth, Purity, Gravity, Timbre, Harmonics, Gain, Detune, Width | Voices, Scale, Unison, Glide
+static const CelestialPreset kFactoryPresets[] = {
+  {"Celestial Init",      {0.50f, 0.30f, 0.40f, 0.60f, 0.80f, 0.50f,  0.00f, 0.50f, 0.50f, 15.0f, 0.70f,  8, 0, 1, 0}},
+  {"Morning Temple",      {0.65f, 0.20f, 0.55f, 0.40f, 0.90f, 0.20f,  0.10f, 0.40f, 0.50f,  8.0f, 0.50f,  8, 0, 1, 0}},
+  {"Jade Pavilion",       {0.55f, 0.35f, 0.50f, 0.50f, 0.85f, 0.30f, -0.10f, 0.60f, 0.50f, 12.0f, 0.60f,  8, 1, 2, 0}},
+  {"Standing Stones",     {0.40f, 0.25f, 0.70f, 0.70f, 0.70f, 0.40f, -0.30f, 0.55f, 0.50f, 18.0f, 0.80f, 12, 2, 3, 0}},
+  {"Gamelan Night",       {0.75f, 0.45f, 0.45f, 0.35f, 0.95f, 0.10f,  0.40f, 0.70f, 0.45f,  6.0f, 0.40f, 10, 3, 1, 0}},
+  {"Highland Drone",      {0.35f, 0.15f, 0.60f, 0.85f, 0.60f, 0.60f, -0.40f, 0.45f, 0.50f, 22.0f, 0.90f,  6, 4, 5, 1}},
+  {"Steppe Throat",       {0.30f, 0.50f, 0.35f, 0.90f, 0.50f, 0.35f, -0.60f, 0.80f, 0.50f, 10.0f, 0.50f,  4, 5, 3, 2}},
+  {"Desert Sanctuary",    {0.50f, 0.40f, 0.80f, 0.65f, 0.75f, 0.45f,  0.20f, 0.50f, 0.45f, 20.0f, 0.85f,  8, 6, 4, 0}},
+  {"Canyon Flute",        {0.60f, 0.55f, 0.65f, 0.45f, 0.90f, 0.55f,  0.30f, 0.30f, 0.50f,  4.0f, 0.30f,  1, 7, 1, 2}},
+  {"Aurora Borealis",     {0.70f, 0.60f, 0.95f, 0.50f, 0.85f, 0.50f,  0.50f, 0.65f, 0.40f, 30.0f, 1.00f, 16, 8, 7, 0}},
+  {"Gravity Lead",        {0.80f, 0.35f, 0.30f, 0.75f, 0.65f, 0.75f,  0.60f, 0.60f, 0.55f, 14.0f, 0.60f,  1, 1, 5, 2}},
+  {"Stellar Choir",       {0.45f, 0.50f, 0.85f, 0.55f, 0.80f, 0.30f, -0.20f, 0.75f, 0.45f, 25.0f, 0.95f, 16, 2, 8, 0}},
+};
+
+// Moves the DSP towards a blend of the current knob positions and one other preset
+// (the morph target), ramping every continuous slot on the audio thread. Knob moves take
+// a short de-zipper ramp, preset recalls take each slot's own, longer ramp so a program
+// change crossfades instead of jumping. Nothing here allocates or touches the voices.
+class PresetMorpher
+{
+public:
+  PresetMorpher()
+  {
+    for (int s = 0; s < kNumPresetSlots; s++)
+    {
+      mSource[s].store(kFactoryPresets[0].values[s], std::memory_order_relaxed);
+      mCurrent[s] = mTarget[s] = kFactoryPresets[0].values[s];
+    }
+  }
+
+  // Any thread: where the knob for a slot is
+  void SetSource(int slot, double value) { mSource[slot].store((float)value, std::memory_order_relaxed); }
+
+  // Any thread: 0 plays the knobs, 1 plays the morph target preset
+  void SetMorphAmount(double amount) { mMorphAmount.store((float)std::clamp(amount, 0.0, 1.0), std::memory_order_relaxed); }
+  void SetMorphTarget(int preset) { mMorphTarget.store(std::clamp(preset, 0, kNumFactoryPresets - 1), std::memory_order_relaxed); }
+
+  // Any thread, around a preset recall. The audio thread holds its targets while a recall is
+  // writing the knobs, then picks them all up at once with the recall ramps.
+  void BeginRecall() { mRecallsInFlight.fetch_add(1, std::memory_order_acq_rel); }
+  void EndRecall()
+  {
+    mRecallSerial.fetch_add(1, std::memory_order_release);
+    mRecallsInFlight.fetch_sub(1, std::memory_order_acq_rel);
+  }
+
+  // Audio thread: jump straight to the targets and push every slot, e.g. from OnReset
+  template <typename ApplyFunc>
+  void Reset(double sampleRate, ApplyFunc&& apply)
+  {
+    mSampleRate = sampleRate;
+    mLastRecallSerial = mRecallSerial.load(std::memory_order_acquire);
+    UpdateTargets(false);
+
+    for (int s = 0; s < kNumPresetSlots; s++)
+    {
+      mCurrent[s] = mTarget[s];
+      mRemaining[s] = 0;
+      apply(s, (double)mCurrent[s]);
+    }
+  }
+
+  // Audio thread, once per block: advance the ramps and push the slots that moved
+  template <typename ApplyFunc>
+  void Process(int nFrames, ApplyFunc&& apply)
+  {
+    if (mRecallsInFlight.load(std::memory_order_acquire) == 0)
+    {
+      const unsigned serial = mRecallSerial.load(std::memory_order_acquire);
+      UpdateTargets(serial != mLastRecallSerial);
+      mLastRecallSerial = serial;
+    }
+
+    for (int s = 0; s < kFirstSteppedSlot; s++)
+    {
+      if (mRemaining[s] <= 0)
+        continue;
+
+      const int n = std::min(nFrames, mRemaining[s]);
+      mRemaining[s] -= n;
+      mCurrent[s] = mRemaining[s] > 0 ? mCurrent[s] + mStep[s] * n : mTarget[s];
+      apply(s, (double)mCurrent[s]);
+    }
+
+    for (int s = kFirstSteppedSlot; s < kNumPresetSlots; s++)
+    {
+      if (mCurrent[s] != mTarget[s])
+      {
+        mCurrent[s] = mTarget[s];
+        apply(s, (double)mCurrent[s]);
+      }
+    }
+  }
+
+  static constexpr int kNumFactoryPresets = (int)(sizeof(kFactoryPresets) / sizeof(kFactoryPresets[0]));
+
+private:
+  void UpdateTargets(bool recalled)
+  {
+    const float amount = mMorphAmount.load(std::memory_order_relaxed);
+    const float* preset = kFactoryPresets[mMorphTarget.load(std::memory_order_relaxed)].values;
+
+    for (int s = 0; s < kFirstSteppedSlot; s++)
+    {
+      const float source = mSource[s].load(std::memory_order_relaxed);
+      const float target = source + (preset[s] - source) * amount;
+      if (target == mTarget[s] && !(recalled && mRemaining[s] > 0))
+        continue;
+
+      // A recall restarts any ramp already running so everything lands together
+      const double ms = recalled ? kRecallRampMs[s] : kSmoothingMs;
+      const int samples = std::max(1, (int)(ms * 0.001 * mSampleRate));
+      mTarget[s] = target;
+      mStep[s] = (target - mCurrent[s]) / samples;
+      mRemaining[s] = samples;
+    }
+
+    // Stepped slots change hands half way through the morph
+    for (int s = kFirstSteppedSlot; s < kNumPresetSlots; s++)
+      mTarget[s] = std::round(amount >= 0.5f ? preset[s] : mSource[s].load(std::memory_order_relaxed));
+  }
+
+  static constexpr double kSmoothingMs = 20.0;
+
+  // Slow enough to hide the change, quick enough to play through. Space ramps longest as it retunes the reverb.
+  static constexpr double kRecallRampMs[kFirstSteppedSlot] = {120.0, 150.0, 400.0, 120.0, 120.0, 50.0, 150.0, 150.0, 80.0, 200.0, 200.0};
+
+  std::atomic<float> mSource[kNumPresetSlots];
+  std::atomic<float> mMorphAmount {0.0f};
+  std::atomic<int> mMorphTarget {0};
+  std::atomic<int> mRecallsInFlight {0};
+  std::atomic<unsigned> mRecallSerial {0};
+
+  // Audio thread only
+  double mSampleRate = 44100.0;
+  unsigned mLastRecallSerial = 0;
+  float mCurrent[kNumPresetSlots] = {};
+  float mTarget[kNumPresetSlots] = {};
+  float mStep[kNumPresetSlots] = {};
+  int mRemaining[kNumPresetSlots] = {};
+};
@@ -0,0 +1,265 @@
+#pragma once
+
+// Real-time safety audit for debug builds. Off unless the build defines CELESTIAL_RT_AUDIT=1, and then
+// the macros at the bottom compile to nothing. With it on, CELESTIAL_RT_AUDIT_SCOPE marks code that runs
+// on the audio thread, and any allocation, free, mutex lock or blocking call made inside a marked scope
+// is reported to stderr with a stack trace.
+//
+// The checks are installed by defining CELESTIAL_RT_AUDIT_IMPLEMENT in exactly one source file of an
+// executable (the standalone app or an offline driver) before including this header: operator new and
+// delete are replaced everywhere, and on glibc malloc, pthread mutexes and blocking syscalls are
+// interposed as well. Interposition doesn't reach into a plugin loaded by a host, so audit there through
+// the standalone app.
+#ifndef CELESTIAL_RT_AUDIT
+#define CELESTIAL_RT_AUDIT 0
+#endif
+
+#if CELESTIAL_RT_AUDIT
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__linux__) && defined(__GLIBC__)
+  #define CELESTIAL_RT_AUDIT_GLIBC
+#endif
+
+#if defined(__linux__) || defined(__APPLE__)
+  #include <execinfo.h>
+  #include <unistd.h>
+  #define CELESTIAL_RT_AUDIT_BACKTRACE
+#endif
+
+// TLS the allocator hooks can touch without the TLS lookup itself allocating
+#if defined(__GNUC__)
+  #define CELESTIAL_RT_AUDIT_TLS thread_local __attribute__((tls_model("initial-exec")))
+#else
+  #define CELESTIAL_RT_AUDIT_TLS thread_local
+#endif
+
+namespace CelestialRealtimeAudit
+{
+inline int& ScopeDepth()
+{
+  static CELESTIAL_RT_AUDIT_TLS int depth = 0;
+  return depth;
+}
+
+// Set while a report is being written, so the reporting itself isn't reported
+inline bool& Reporting()
+{
+  static CELESTIAL_RT_AUDIT_TLS bool reporting = false;
+  return reporting;
+}
+
+inline std::atomic<int>& ViolationCount()
+{
+  static std::atomic<int> count {0};
+  return count;
+}
+
+// Any thread. Total violations reported since the start of the process.
+inline int GetViolationCount() { return ViolationCount().load(std::memory_order_relaxed); }
+
+inline void Report(const char* what)
+{
+  if (ScopeDepth() <= 0 || Reporting())
+    return;
+
+  Reporting() = true;
+  ViolationCount().fetch_add(1, std::memory_order_relaxed);
+
+#ifdef CELESTIAL_RT_AUDIT_BACKTRACE
+  char header[160];
+  const int n = snprintf(header, sizeof(header), "[realtime audit] %s on the audio thread\n", what);
+  if (n > 0)
+    (void)!write(STDERR_FILENO, header, (size_t)n < sizeof(header) ? (size_t)n : sizeof(header) - 1);
+
+  void* frames[32];
+  const int numFrames = backtrace(frames, 32);
+  backtrace_symbols_fd(frames + 1, numFrames - 1, STDERR_FILENO);
+#else
+  fprintf(stderr, "[realtime audit] %s on the audio thread\n", what);
+#endif
+
+  // CELESTIAL_RT_AUDIT_ABORT=1 stops at the first one, for running under a debugger
+  const char* abortOnViolation = getenv("CELESTIAL_RT_AUDIT_ABORT");
+  Reporting() = false;
+  if (abortOnViolation && abortOnViolation[0] == '1')
+    abort();
+}
+
+// Marks the audio thread for as long as it lives, nests
+class Scope
+{
+public:
+  Scope() { ScopeDepth()++; }
+  ~Scope() { ScopeDepth()--; }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+};
+} // namespace CelestialRealtimeAudit
+
+#define CELESTIAL_RT_AUDIT_CONCAT2(a, b) a##b
+#define CELESTIAL_RT_AUDIT_CONCAT(a, b) CELESTIAL_RT_AUDIT_CONCAT2(a, b)
+#define CELESTIAL_RT_AUDIT_SCOPE() CelestialRealtimeAudit::Scope CELESTIAL_RT_AUDIT_CONCAT(celestialAudit, __LINE__)
+
+#ifdef CELESTIAL_RT_AUDIT_IMPLEMENT
+
+#include <new>
+
+namespace CelestialRealtimeAudit
+{
+// operator new/delete report once themselves, not again for the malloc/free underneath
+inline void* MallocUnreported(std::size_t size)
+{
+  const bool reporting = Reporting();
+  Reporting() = true;
+  void* p = std::malloc(size ? size : 1);
+  Reporting() = reporting;
+  return p;
+}
+
+inline void FreeUnreported(void* p)
+{
+  const bool reporting = Reporting();
+  Reporting() = true;
+  std::free(p);
+  Reporting() = reporting;
+}
+} // namespace CelestialRealtimeAudit
+
+void* operator new(std::size_t size)
+{
+  CelestialRealtimeAudit::Report("operator new");
+  if (void* p = CelestialRealtimeAudit::MallocUnreported(size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+  CelestialRealtimeAudit::Report("operator new[]");
+  if (void* p = CelestialRealtimeAudit::MallocUnreported(size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  CelestialRealtimeAudit::Report("operator new");
+  return CelestialRealtimeAudit::MallocUnreported(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  CelestialRealtimeAudit::Report("operator new[]");
+  return CelestialRealtimeAudit::MallocUnreported(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  if (p)
+    CelestialRealtimeAudit::Report("operator delete");
+  CelestialRealtimeAudit::FreeUnreported(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  if (p)
+    CelestialRealtimeAudit::Report("operator delete[]");
+  CelestialRealtimeAudit::FreeUnreported(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, std::size_t) noexcept { operator delete[](p); }
+
+#ifdef CELESTIAL_RT_AUDIT_GLIBC
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+
+// noexcept like glibc's own declarations (__THROW), so these still match when <stdlib.h> or
+// <mm_malloc.h> is only included after this header
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* p);
+
+void* malloc(size_t size) noexcept
+{
+  CelestialRealtimeAudit::Report("malloc");
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept
+{
+  CelestialRealtimeAudit::Report("calloc");
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) noexcept
+{
+  CelestialRealtimeAudit::Report("realloc");
+  return __libc_realloc(p, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept
+{
+  CelestialRealtimeAudit::Report("aligned_alloc");
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** p, size_t alignment, size_t size) noexcept
+{
+  CelestialRealtimeAudit::Report("posix_memalign");
+  *p = __libc_memalign(alignment, size);
+  return *p ? 0 : ENOMEM;
+}
+
+void free(void* p) noexcept
+{
+  if (p)
+    CelestialRealtimeAudit::Report("free");
+  __libc_free(p);
+}
+} // extern "C"
+
+// Everything else forwards to the next definition, i.e. libc's
+#define CELESTIAL_RT_AUDIT_INTERPOSE(ret, name, params, args) \
+  extern "C" ret name params \
+  { \
+    CelestialRealtimeAudit::Report(#name); \
+    static ret (*next) params = (ret (*) params)dlsym(RTLD_NEXT, #name); \
+    return next args; \
+  }
+
+// Condition variable waits need a locked mutex first, so the mutex catches those too
+CELESTIAL_RT_AUDIT_INTERPOSE(int, pthread_mutex_lock, (pthread_mutex_t* m), (m))
+CELESTIAL_RT_AUDIT_INTERPOSE(int, pthread_rwlock_rdlock, (pthread_rwlock_t* l), (l))
+CELESTIAL_RT_AUDIT_INTERPOSE(int, pthread_rwlock_wrlock, (pthread_rwlock_t* l), (l))
+CELESTIAL_RT_AUDIT_INTERPOSE(int, sem_wait, (sem_t* s), (s))
+CELESTIAL_RT_AUDIT_INTERPOSE(int, nanosleep, (const struct timespec* t, struct timespec* rem), (t, rem))
+CELESTIAL_RT_AUDIT_INTERPOSE(int, clock_nanosleep, (clockid_t c, int flags, const struct timespec* t, struct timespec* rem), (c, flags, t, rem))
+CELESTIAL_RT_AUDIT_INTERPOSE(int, usleep, (useconds_t us), (us))
+CELESTIAL_RT_AUDIT_INTERPOSE(ssize_t, read, (int fd, void* buf, size_t n), (fd, buf, n))
+CELESTIAL_RT_AUDIT_INTERPOSE(ssize_t, write, (int fd, const void* buf, size_t n), (fd, buf, n))
+CELESTIAL_RT_AUDIT_INTERPOSE(FILE*, fopen, (const char* path, const char* mode), (path, mode))
+
+#undef CELESTIAL_RT_AUDIT_INTERPOSE
+
+#endif // CELESTIAL_RT_AUDIT_GLIBC
+#endif // CELESTIAL_RT_AUDIT_IMPLEMENT
+
+#else
+
+#define CELESTIAL_RT_AUDIT_SCOPE()
+
+#endif
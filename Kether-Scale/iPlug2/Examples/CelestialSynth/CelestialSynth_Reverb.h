@@ -0,0 +1,265 @@
+#pragma once
+
+#include "IPlugPlatform.h"
+#include <vector>
+#include <cmath>
+#include <cstring>
+
+using namespace iplug;
+
+// 8-line feedback delay network reverb
+// Line state is held as 8-wide lane arrays and the delay memory is interleaved
+// (one frame = 8 lanes), so the Hadamard mix, damping and decay are straight
+// lane loops the compiler vectorises, and every write is one contiguous store.
+// T is the type of the delay memory and signal path; delay times and LFOs stay in double.
+template <typename T>
+class FDNReverb
+{
+public:
+  static constexpr int kNumLines = 8;
+
+  // Allocates delay memory for the given sample rate - call off the audio thread
+  void Reset(double sampleRate)
+  {
+    mSampleRate = sampleRate;
+
+    const double maxDelay = kBaseDelaysMs[kNumLines - 1] * kMaxSizeScale * 0.001 * sampleRate + kModDepthMs * 0.001 * sampleRate + 4.0;
+    int size = 1;
+    while (size < maxDelay)
+      size <<= 1;
+
+    mBufferFrames = size;
+    mMask = size - 1;
+    mBuffer.assign((size_t)size * kNumLines, T(0));
+    mWritePos = 0;
+
+    for (int i = 0; i < kNumLines; i++)
+    {
+      const double lfoRate = 0.13 + 0.07 * i; // Hz, detuned per line so the modulation never beats in sync
+      const double w = 2.0 * 3.14159265359 * lfoRate / sampleRate;
+      mLfoCos[i] = std::cos(w);
+      mLfoSin[i] = std::sin(w);
+      mLfoS[i] = std::sin(i * 0.785398163397); // spread start phases by pi/4
+      mLfoC[i] = std::cos(i * 0.785398163397);
+      mDamp[i] = T(0);
+    }
+
+    mModDepth = kModDepthMs * 0.001 * sampleRate;
+    mDirty = true;
+    UpdateCoefficients();
+    for (int i = 0; i < kNumLines; i++)
+      mDelay[i] = mTargetDelay[i];
+
+    mSilentSamples = 0;
+    mIdle = true;
+  }
+
+  // 0-1, scales the line lengths
+  void SetSize(double size) { mSize = size; mDirty = true; }
+  // RT60 in seconds
+  void SetDecayTime(double seconds) { mDecayTime = std::max(0.1, seconds); mDirty = true; }
+  // 0-1, high frequency absorption inside the loop
+  void SetDamping(double damping) { mDamping = damping; mDirty = true; }
+
+  // Frees the delay memory, ProcessBlock does nothing until the next Reset - call off the audio thread
+  void Release()
+  {
+    std::vector<T>().swap(mBuffer);
+    mSilentSamples = 0;
+    mIdle = true;
+  }
+
+  bool IsIdle() const { return mIdle; }
+
+  // Empties the network without reallocating, safe on the audio thread
+  void Clear()
+  {
+    if (!mBuffer.empty())
+      std::memset(mBuffer.data(), 0, mBuffer.size() * sizeof(T));
+    for (int i = 0; i < kNumLines; i++)
+      mDamp[i] = T(0);
+    mSilentSamples = 0;
+    mIdle = true;
+  }
+
+  // Time for a full scale input to decay by 120dB at the current settings
+  int GetTailSamples() const { return (int)(2.0 * mDecayTime * mSampleRate) + mBufferFrames; }
+
+  // Adds wet * reverb(input) to the buffers in place. Once the tail has decayed and
+  // the input is silent the network is cleared and further blocks return immediately.
+  void ProcessBlock(T* left, T* right, int nFrames, double wet)
+  {
+    if (mBuffer.empty())
+      return;
+
+    if (mIdle)
+    {
+      if (wet <= 0.0 || !HasSignal(left, right, nFrames))
+        return;
+
+      mIdle = false;
+      mSilentSamples = 0;
+    }
+
+    if (mDirty)
+      UpdateCoefficients();
+
+    T* buffer = mBuffer.data();
+    T outPeak = T(0);
+    bool inputActive = false;
+
+    alignas(16) T tap[kNumLines];
+    alignas(16) T mix[kNumLines];
+
+    for (int s = 0; s < nFrames; s++)
+    {
+      const T inL = left[s];
+      const T inR = right[s];
+
+      if (std::fabs(inL) + std::fabs(inR) > T(kSilenceThreshold))
+        inputActive = true;
+
+      // Modulated, linearly interpolated taps
+      for (int i = 0; i < kNumLines; i++)
+      {
+        mDelay[i] += (mTargetDelay[i] - mDelay[i]) * kDelaySmoothing;
+
+        const double lfoS = mLfoS[i] * mLfoCos[i] + mLfoC[i] * mLfoSin[i];
+        const double lfoC = mLfoC[i] * mLfoCos[i] - mLfoS[i] * mLfoSin[i];
+        mLfoS[i] = lfoS;
+        mLfoC[i] = lfoC;
+
+        const double d = mDelay[i] + mModDepth * lfoS;
+        const int di = (int)d;
+        const T frac = (T)(d - di);
+        const T a = buffer[((mWritePos - di) & mMask) * kNumLines + i];
+        const T b = buffer[((mWritePos - di - 1) & mMask) * kNumLines + i];
+        tap[i] = a + (b - a) * frac;
+      }
+
+      // Damping and per-line decay
+      for (int i = 0; i < kNumLines; i++)
+      {
+        mDamp[i] = tap[i] + (mDamp[i] - tap[i]) * mDampCoeff;
+        mix[i] = mDamp[i] * mGain[i];
+      }
+
+      // Hadamard mix as three butterfly stages
+      for (int h = 1; h < kNumLines; h <<= 1)
+      {
+        for (int i = 0; i < kNumLines; i += h << 1)
+        {
+          for (int j = i; j < i + h; j++)
+          {
+            const T x = mix[j];
+            const T y = mix[j + h];
+            mix[j] = x + y;
+            mix[j + h] = x - y;
+          }
+        }
+      }
+
+      // Inject the input with alternating polarity, left into even lines, right into odd
+      T* frame = buffer + (size_t)(mWritePos & mMask) * kNumLines;
+      for (int i = 0; i < kNumLines; i++)
+      {
+        const T in = (i & 1) ? inR : inL;
+        frame[i] = mix[i] * T(kHadamardNorm) + in * T(kInputSigns[i]);
+      }
+
+      mWritePos = (mWritePos + 1) & mMask;
+
+      const T outL = (tap[0] - tap[2] + tap[4] - tap[6]) * T(0.5);
+      const T outR = (tap[1] - tap[3] + tap[5] - tap[7]) * T(0.5);
+      outPeak = std::max(outPeak, std::fabs(outL) + std::fabs(outR));
+
+      mWet += (wet - mWet) * kWetSmoothing;
+      left[s] += outL * (T)mWet;
+      right[s] += outR * (T)mWet;
+    }
+
+    // Keep the rotating LFOs on the unit circle
+    for (int i = 0; i < kNumLines; i++)
+    {
+      const double norm = 1.5 - 0.5 * (mLfoS[i] * mLfoS[i] + mLfoC[i] * mLfoC[i]);
+      mLfoS[i] *= norm;
+      mLfoC[i] *= norm;
+    }
+
+    if (inputActive)
+      mSilentSamples = 0;
+    else
+      mSilentSamples = std::min(mSilentSamples + nFrames, mTailSamples + 1);
+
+    // Only after the expected tail length has elapsed do we look at the actual output
+    if (mSilentSamples > mTailSamples && outPeak < T(kSilenceThreshold))
+      Clear();
+  }
+
+private:
+  static bool HasSignal(const T* left, const T* right, int nFrames)
+  {
+    for (int s = 0; s < nFrames; s++)
+    {
+      if (std::fabs(left[s]) + std::fabs(right[s]) > T(kSilenceThreshold))
+        return true;
+    }
+    return false;
+  }
+
+  void UpdateCoefficients()
+  {
+    const double sizeScale = kMinSizeScale + (kMaxSizeScale - kMinSizeScale) * std::min(1.0, std::max(0.0, mSize));
+    double longest = 0.0;
+
+    for (int i = 0; i < kNumLines; i++)
+    {
+      mTargetDelay[i] = kBaseDelaysMs[i] * sizeScale * 0.001 * mSampleRate;
+      longest = std::max(longest, mTargetDelay[i]);
+      // Per-line gain so every line loses 60dB over the same RT60
+      mGain[i] = (T)std::pow(10.0, -3.0 * mTargetDelay[i] / (mDecayTime * mSampleRate));
+    }
+
+    mDampCoeff = (T)(0.05 + 0.6 * std::min(1.0, std::max(0.0, mDamping)));
+    // Time for the tail to fall 120dB from full scale, plus one trip round the longest line
+    mTailSamples = (int)(2.0 * mDecayTime * mSampleRate + longest + mModDepth);
+    mDirty = false;
+  }
+
+  static constexpr double kBaseDelaysMs[kNumLines] = {29.7, 37.1, 41.1, 43.7, 53.3, 59.9, 67.7, 79.3};
+  static constexpr double kInputSigns[kNumLines] = {1.0, 1.0, -1.0, -1.0, 1.0, 1.0, -1.0, -1.0};
+  static constexpr double kMinSizeScale = 0.4;
+  static constexpr double kMaxSizeScale = 1.3;
+  static constexpr double kModDepthMs = 0.3;
+  static constexpr double kHadamardNorm = 0.35355339059327373; // 1/sqrt(8)
+  static constexpr double kDelaySmoothing = 0.0005;
+  static constexpr double kWetSmoothing = 0.001;
+  static constexpr double kSilenceThreshold = 1e-5; // ~-100dB
+
+  std::vector<T> mBuffer;
+  int mBufferFrames = 0;
+  int mMask = 0;
+  int mWritePos = 0;
+  double mSampleRate = 44100.0;
+
+  double mSize = 0.5;
+  double mDecayTime = 2.0;
+  double mDamping = 0.3;
+  bool mDirty = true;
+
+  alignas(16) double mDelay[kNumLines] = {};
+  alignas(16) double mTargetDelay[kNumLines] = {};
+  alignas(16) T mGain[kNumLines] = {};
+  alignas(16) T mDamp[kNumLines] = {};
+  alignas(16) double mLfoS[kNumLines] = {};
+  alignas(16) double mLfoC[kNumLines] = {};
+  alignas(16) double mLfoSin[kNumLines] = {};
+  alignas(16) double mLfoCos[kNumLines] = {};
+  T mDampCoeff = T(0.3);
+  double mWet = 0.0;
+  double mModDepth = 0.0;
+
+  int mSilentSamples = 0;
+  int mTailSamples = 0;
+  bool mIdle = true;
+};
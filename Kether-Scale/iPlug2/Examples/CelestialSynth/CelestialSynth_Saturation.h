@@ -0,0 +1,292 @@
+#pragma once
+
+#include "IPlugPlatform.h"
+#include <cmath>
+
+using namespace iplug;
+
+// [7/6] Pade approximation of tanh, clamped where it reaches +/-1.
+// Branch free, so loops over a buffer vectorise.
+template <typename T>
+inline T FastTanh(T x)
+{
+  x = std::min(T(4.97), std::max(T(-4.97), x));
+  const T x2 = x * x;
+  const T num = x * (T(135135) + x2 * (T(17325) + x2 * (T(378) + x2)));
+  const T den = T(135135) + x2 * (T(62370) + x2 * (T(3150) + x2 * T(28)));
+  return std::min(T(1), std::max(T(-1), num / den));
+}
+
+// Polyphase IIR half-band filter: two chains of first order allpasses running at the low
+// rate, one per polyphase branch. Coefficient design follows the classic elliptic half-band
+// method (Valenzuela & Constantinides), as popularised by Laurent de Soras' HIIR.
+template <int NC, typename T>
+class HalfBandFilter
+{
+public:
+  // transition: normalised transition bandwidth, the passband ends at (0.25 - transition) * fs
+  void Design(double transition)
+  {
+    double k, q;
+    const double kt = std::tan((1.0 - transition * 2.0) * 3.14159265358979 / 4.0);
+    k = kt * kt;
+    const double kksqrt = std::pow(1.0 - k * k, 0.25);
+    const double e = 0.5 * (1.0 - kksqrt) / (1.0 + kksqrt);
+    const double e2 = e * e;
+    const double e4 = e2 * e2;
+    q = e * (1.0 + e4 * (2.0 + e4 * (15.0 + 150.0 * e4)));
+
+    const int order = NC * 2 + 1;
+    for (int i = 0; i < NC; i++)
+    {
+      const int c = i + 1;
+      double num = 0.0, den = 0.0, term;
+
+      int j = 0, sign = 1;
+      do
+      {
+        term = std::pow(q, j * (j + 1)) * std::sin((j * 2 + 1) * c * 3.14159265358979 / order) * sign;
+        num += term;
+        sign = -sign;
+        j++;
+      } while (std::fabs(term) > 1e-100);
+
+      j = 1;
+      sign = -1;
+      do
+      {
+        term = std::pow(q, j * j) * std::cos(j * 2 * c * 3.14159265358979 / order) * sign;
+        den += term;
+        sign = -sign;
+        j++;
+      } while (std::fabs(term) > 1e-100);
+
+      const double ww = num * std::pow(q, 0.25) / (den + 0.5);
+      const double wwsq = ww * ww;
+      const double x = std::sqrt((1.0 - wwsq * k) * (1.0 - wwsq / k)) / (1.0 + wwsq);
+      mCoefs[i] = (T)((1.0 - x) / (1.0 + x));
+    }
+  }
+
+  void Reset()
+  {
+    for (int i = 0; i < NC; i++)
+      mX[i] = mY[i] = T(0);
+  }
+
+  // Zero any state that has decayed to the denormal range
+  void Flush()
+  {
+    for (int i = 0; i < NC; i++)
+    {
+      if (std::fabs(mX[i]) < T(1e-20)) mX[i] = T(0);
+      if (std::fabs(mY[i]) < T(1e-20)) mY[i] = T(0);
+    }
+  }
+
+  // One low rate sample in, two high rate samples out
+  inline void Upsample(T input, T& out0, T& out1)
+  {
+    T even = input;
+    T odd = input;
+    RunBranches(even, odd);
+    out0 = even;
+    out1 = odd;
+  }
+
+  // Two high rate samples in, one low rate sample out
+  inline T Downsample(T in0, T in1)
+  {
+    T even = in1;
+    T odd = in0;
+    RunBranches(even, odd);
+    return T(0.5) * (even + odd);
+  }
+
+private:
+  inline void RunBranches(T& even, T& odd)
+  {
+    for (int i = 0; i < NC; i += 2)
+    {
+      const T x0 = mX[i];
+      mX[i] = even;
+      even = (even - mY[i]) * mCoefs[i] + x0;
+      mY[i] = even;
+
+      const T x1 = mX[i + 1];
+      mX[i + 1] = odd;
+      odd = (odd - mY[i + 1]) * mCoefs[i + 1] + x1;
+      mY[i + 1] = odd;
+    }
+  }
+
+  T mCoefs[NC] = {};
+  T mX[NC] = {};
+  T mY[NC] = {};
+};
+
+// Warmth + Purity waveshaper with optional 2x/4x oversampling around the nonlinearity only.
+// Works on fixed size chunks so no buffers are allocated, and the shaping loop runs over a
+// contiguous high rate buffer that the compiler vectorises.
+template <typename T>
+class Saturator
+{
+public:
+  enum EOversampling
+  {
+    kOversampleNone = 0,
+    kOversample2x,
+    kOversample4x,
+    kNumOversampling
+  };
+
+  static constexpr int kMaxChannels = 2;
+
+  Saturator()
+  {
+    for (int c = 0; c < kMaxChannels; c++)
+    {
+      mUp1[c].Design(0.04);
+      mDown1[c].Design(0.04);
+      mUp2[c].Design(0.13);
+      mDown2[c].Design(0.13);
+    }
+  }
+
+  void Reset()
+  {
+    for (int c = 0; c < kMaxChannels; c++)
+    {
+      mUp1[c].Reset();
+      mDown1[c].Reset();
+      mUp2[c].Reset();
+      mDown2[c].Reset();
+    }
+  }
+
+  void SetOversampling(int mode)
+  {
+    if (mode >= kOversampleNone && mode < kNumOversampling && mode != mOversampling)
+    {
+      mOversampling = mode;
+      Reset();
+    }
+  }
+
+  int GetOversampling() const { return mOversampling; }
+
+  void SetWarmth(double value) { mWarmth = value; }
+  void SetPurity(double value) { mPurity = value; }
+
+  void ProcessBlock(T** io, int nChans, int nFrames)
+  {
+    const bool warmthActive = mWarmth > 0.1;
+    const bool purityActive = mPurity < 0.9;
+
+    if (!warmthActive && !purityActive)
+    {
+      mActive = false;
+      return;
+    }
+
+    // Don't let stale filter memory from the last time we ran leak into the signal
+    if (!mActive)
+    {
+      Reset();
+      mActive = true;
+    }
+
+    // Same curves as before: Warmth drives a normalised tanh, Purity a second, gentler one
+    const double warmthAmount = mWarmth * 0.5;
+    const T drive1 = (T)(warmthActive ? 1.0 + warmthAmount : 0.0);
+    const T norm1 = (T)(warmthActive ? 1.0 / (1.0 + warmthAmount * 0.5) : 1.0);
+    const T drive2 = (T)(purityActive ? 1.0 + (1.0 - mPurity) * 0.2 : 0.0);
+    const int factor = 1 << mOversampling;
+
+    for (int c = 0; c < std::min(nChans, (int)kMaxChannels); c++)
+    {
+      T* buf = io[c];
+
+      for (int start = 0; start < nFrames; start += kChunkSize)
+      {
+        const int n = std::min(kChunkSize, nFrames - start);
+        const int nHigh = n * factor;
+
+        // Up
+        switch (mOversampling)
+        {
+          case kOversampleNone:
+            for (int s = 0; s < n; s++)
+              mWork[s] = buf[start + s];
+            break;
+          case kOversample2x:
+            for (int s = 0; s < n; s++)
+              mUp1[c].Upsample(buf[start + s], mWork[2 * s], mWork[2 * s + 1]);
+            break;
+          case kOversample4x:
+            for (int s = 0; s < n; s++)
+            {
+              T a, b;
+              mUp1[c].Upsample(buf[start + s], a, b);
+              mUp2[c].Upsample(a, mWork[4 * s], mWork[4 * s + 1]);
+              mUp2[c].Upsample(b, mWork[4 * s + 2], mWork[4 * s + 3]);
+            }
+            break;
+        }
+
+        // Shape
+        if (warmthActive)
+        {
+          for (int s = 0; s < nHigh; s++)
+            mWork[s] = FastTanh(mWork[s] * drive1) * norm1;
+        }
+
+        if (purityActive)
+        {
+          for (int s = 0; s < nHigh; s++)
+            mWork[s] = FastTanh(mWork[s] * drive2);
+        }
+
+        // Down
+        switch (mOversampling)
+        {
+          case kOversampleNone:
+            for (int s = 0; s < n; s++)
+              buf[start + s] = mWork[s];
+            break;
+          case kOversample2x:
+            for (int s = 0; s < n; s++)
+              buf[start + s] = mDown1[c].Downsample(mWork[2 * s], mWork[2 * s + 1]);
+            break;
+          case kOversample4x:
+            for (int s = 0; s < n; s++)
+            {
+              const T a = mDown2[c].Downsample(mWork[4 * s], mWork[4 * s + 1]);
+              const T b = mDown2[c].Downsample(mWork[4 * s + 2], mWork[4 * s + 3]);
+              buf[start + s] = mDown1[c].Downsample(a, b);
+            }
+            break;
+        }
+      }
+
+      // The allpass recursions decay towards zero forever once the voices stop
+      mUp1[c].Flush();
+      mDown1[c].Flush();
+      mUp2[c].Flush();
+      mDown2[c].Flush();
+    }
+  }
+
+private:
+  static constexpr int kChunkSize = 64;
+
+  // Up and down paths each need their own filter memory, per stage and channel
+  HalfBandFilter<8, T> mUp1[kMaxChannels], mDown1[kMaxChannels];
+  HalfBandFilter<4, T> mUp2[kMaxChannels], mDown2[kMaxChannels];
+
+  alignas(16) T mWork[kChunkSize * 4];
+  double mWarmth = 0.6;
+  double mPurity = 0.8;
+  int mOversampling = kOversample2x;
+  bool mActive = false;
+};
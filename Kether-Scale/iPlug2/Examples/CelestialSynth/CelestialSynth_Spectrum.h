@@ -0,0 +1,171 @@
+#pragma once
+
+#include "CelestialSynth_Convolver.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+// Audio thread side of the spectrum view: copies the mono sum of the main bus into a ring the UI
+// reads from. Disabled while the editor is closed, then it costs one relaxed load per block.
+class SpectrumTap
+{
+public:
+  static constexpr int kRingSize = 16384; // power of two, several FFT frames deep so the reader never meets the writer
+
+  // Any thread
+  void SetEnabled(bool enabled) { mEnabled.store(enabled, std::memory_order_relaxed); }
+  void SetSampleRate(double sampleRate) { mSampleRate.store(sampleRate, std::memory_order_relaxed); }
+  double GetSampleRate() const { return mSampleRate.load(std::memory_order_relaxed); }
+
+  // Audio thread
+  template <typename T>
+  void Push(T** io, int nChans, int nFrames)
+  {
+    if (!mEnabled.load(std::memory_order_relaxed) || nChans < 1)
+      return;
+
+    uint32_t w = mWritePos.load(std::memory_order_relaxed);
+    for (int s = 0; s < nFrames; s++, w++)
+      mRing[w & (kRingSize - 1)] = nChans > 1 ? 0.5f * (float)(io[0][s] + io[1][s]) : (float)io[0][s];
+
+    mWritePos.store(w, std::memory_order_release);
+  }
+
+  // UI thread: copies the newest n samples, n at most kRingSize / 2. Returns the write position
+  // they end at, so the caller can tell whether anything new has arrived.
+  uint32_t Read(float* dest, int n) const
+  {
+    const uint32_t end = mWritePos.load(std::memory_order_acquire);
+    const uint32_t start = end - (uint32_t)n;
+    for (int i = 0; i < n; i++)
+      dest[i] = mRing[(start + i) & (kRingSize - 1)];
+    return end;
+  }
+
+  uint32_t GetWritePosition() const { return mWritePos.load(std::memory_order_acquire); }
+
+private:
+  float mRing[kRingSize] = {};
+  std::atomic<uint32_t> mWritePos {0};
+  std::atomic<bool> mEnabled {false};
+  std::atomic<double> mSampleRate {44100.0};
+};
+
+// UI thread side: Hann windowed FFT of the newest frame, folded into log spaced bands with peak hold
+class SpectrumAnalyzer
+{
+public:
+  static constexpr int kFFTSize = 4096;
+  static constexpr int kNumBands = 120;
+  static constexpr double kMinHz = 20.0;
+  static constexpr double kMaxHz = 20000.0;
+  static constexpr float kFloorDB = -96.f;
+  static constexpr float kFallDBPerSecond = 36.f;
+  static constexpr float kPeakHoldSeconds = 1.5f;
+  static constexpr float kPeakFallDBPerSecond = 18.f;
+
+  SpectrumAnalyzer()
+  {
+    mFFT.Init(kFFTSize);
+    mWindow.resize(kFFTSize);
+    mRe.resize(kFFTSize);
+    mIm.resize(kFFTSize);
+    mBinDB.resize(kFFTSize / 2 + 1);
+
+    // Hann, scaled so a full scale sine reads 0dB
+    double sum = 0.0;
+    for (int i = 0; i < kFFTSize; i++)
+    {
+      mWindow[i] = (float)(0.5 - 0.5 * std::cos(2.0 * 3.14159265358979 * i / kFFTSize));
+      sum += mWindow[i];
+    }
+    for (float& w : mWindow)
+      w *= (float)(2.0 / sum);
+
+    for (int b = 0; b < kNumBands; b++)
+      mBandDB[b] = mPeakDB[b] = kFloorDB;
+  }
+
+  // Where a frequency sits along the log axis, 0 at kMinHz and 1 at kMaxHz
+  static double FrequencyToPosition(double hz) { return std::log(hz / kMinHz) / std::log(kMaxHz / kMinHz); }
+  static double PositionToFrequency(double pos) { return kMinHz * std::pow(kMaxHz / kMinHz, pos); }
+
+  float GetBandDB(int band) const { return mBandDB[band]; }
+  float GetPeakDB(int band) const { return mPeakDB[band]; }
+
+  // Analyses the newest frame if the tap has moved on, then lets the bands and peaks fall for the
+  // time that has passed. Returns false once there is nothing left to redraw.
+  bool Update(const SpectrumTap& tap)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    const float elapsed = std::min(0.25f, std::chrono::duration<float>(now - mLastUpdate).count());
+    mLastUpdate = now;
+
+    const bool fresh = tap.GetWritePosition() != mLastWritePos;
+    if (fresh)
+    {
+      mLastWritePos = tap.Read(mRe.data(), kFFTSize);
+      Analyse(tap.GetSampleRate());
+    }
+
+    bool moving = fresh;
+    for (int b = 0; b < kNumBands; b++)
+    {
+      const float level = fresh ? mFrameDB[b] : kFloorDB;
+      mBandDB[b] = std::max(level, mBandDB[b] - kFallDBPerSecond * elapsed);
+
+      if (mBandDB[b] >= mPeakDB[b])
+      {
+        mPeakDB[b] = mBandDB[b];
+        mPeakAge[b] = 0.f;
+      }
+      else if ((mPeakAge[b] += elapsed) > kPeakHoldSeconds)
+      {
+        mPeakDB[b] = std::max(kFloorDB, mPeakDB[b] - kPeakFallDBPerSecond * elapsed);
+      }
+
+      moving |= mBandDB[b] > kFloorDB || mPeakDB[b] > kFloorDB;
+    }
+    return moving;
+  }
+
+private:
+  void Analyse(double sampleRate)
+  {
+    for (int i = 0; i < kFFTSize; i++)
+    {
+      mRe[i] *= mWindow[i];
+      mIm[i] = 0.f;
+    }
+
+    mFFT.Transform(mRe.data(), mIm.data(), false);
+
+    for (int k = 0; k <= kFFTSize / 2; k++)
+      mBinDB[k] = 10.f * std::log10(std::max(1e-12f, mRe[k] * mRe[k] + mIm[k] * mIm[k]));
+
+    // Each band takes its loudest bin. Low bands narrower than a bin read the bin they fall in.
+    const double binHz = sampleRate / kFFTSize;
+    for (int b = 0; b < kNumBands; b++)
+    {
+      const double lo = PositionToFrequency((double)b / kNumBands);
+      const double hi = PositionToFrequency((double)(b + 1) / kNumBands);
+      const int first = std::min(kFFTSize / 2, (int)(lo / binHz + 0.5));
+      const int last = std::min(kFFTSize / 2, std::max(first, (int)(hi / binHz + 0.5)));
+
+      float db = kFloorDB;
+      for (int k = first; k <= last; k++)
+        db = std::max(db, mBinDB[k]);
+      mFrameDB[b] = db;
+    }
+  }
+
+  ConvolutionFFT mFFT;
+  std::vector<float> mWindow, mRe, mIm, mBinDB;
+  float mFrameDB[kNumBands] = {};
+  float mBandDB[kNumBands] = {};
+  float mPeakDB[kNumBands] = {};
+  float mPeakAge[kNumBands] = {};
+  uint32_t mLastWritePos = 0;
+  std::chrono::steady_clock::time_point mLastUpdate = std::chrono::steady_clock::now();
+};
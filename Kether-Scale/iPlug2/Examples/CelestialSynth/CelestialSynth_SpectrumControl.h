@@ -0,0 +1,88 @@
+#pragma once
+
+#include "IControl.h"
+#include "CelestialSynth_Spectrum.h"
+#include <chrono>
+#include <functional>
+
+using namespace iplug;
+using namespace igraphics;
+
+// Log frequency spectrum with peak hold and vertical markers, e.g. at the current scale's pitches.
+// All analysis happens here on the UI thread, the audio thread only fills the SpectrumTap.
+class CelestialSpectrumControl : public IControl
+{
+public:
+  static constexpr int kMaxMarkers = 64;
+  static constexpr float kRangeDB = 84.f; // 0dB at the top
+  static constexpr double kMaxFrameRate = 30.0; // the bands move slowly enough that every other UI frame is plenty
+
+  // Fills freqs with up to maxMarkers frequencies to mark, returns how many
+  using MarkerFunc = std::function<int(double* freqs, int maxMarkers)>;
+
+  CelestialSpectrumControl(const IRECT& bounds, const SpectrumTap& tap, MarkerFunc markerFunc, const IColor& color, const IColor& markerColor)
+  : IControl(bounds)
+  , mTap(tap)
+  , mMarkerFunc(std::move(markerFunc))
+  , mColor(color)
+  , mMarkerColor(markerColor)
+  {
+    mIgnoreMouse = true;
+  }
+
+  // Polled every frame, so this is where the analysis runs, at most kMaxFrameRate times a second.
+  // Once the tail has fallen away it stops asking for redraws.
+  bool IsDirty() override
+  {
+    const auto now = std::chrono::steady_clock::now();
+    if (now - mLastFrame < std::chrono::duration<double>(1.0 / kMaxFrameRate))
+      return IControl::IsDirty();
+
+    mLastFrame = now;
+    return mAnalyzer.Update(mTap) || IControl::IsDirty();
+  }
+
+  void Draw(IGraphics& g) override
+  {
+    g.FillRect(COLOR_BLACK.WithOpacity(0.35f), mRECT);
+
+    double freqs[kMaxMarkers];
+    const int nMarkers = mMarkerFunc ? std::min(kMaxMarkers, mMarkerFunc(freqs, kMaxMarkers)) : 0;
+    for (int m = 0; m < nMarkers; m++)
+    {
+      const double pos = SpectrumAnalyzer::FrequencyToPosition(freqs[m]);
+      if (pos < 0.0 || pos > 1.0)
+        continue;
+
+      const float x = mRECT.L + (float)pos * mRECT.W();
+      g.DrawLine(mMarkerColor, x, mRECT.T, x, mRECT.B);
+    }
+
+    const float bandWidth = mRECT.W() / SpectrumAnalyzer::kNumBands;
+    for (int b = 0; b < SpectrumAnalyzer::kNumBands; b++)
+    {
+      const float x = mRECT.L + b * bandWidth;
+      const float level = GetY(mAnalyzer.GetBandDB(b));
+      const float peak = GetY(mAnalyzer.GetPeakDB(b));
+
+      if (level < mRECT.B)
+        g.FillRect(mColor.WithOpacity(0.6f), IRECT(x, level, x + bandWidth - 1.f, mRECT.B));
+      if (peak < mRECT.B)
+        g.DrawLine(mColor, x, peak, x + bandWidth - 1.f, peak);
+    }
+  }
+
+private:
+  float GetY(float db) const
+  {
+    const float norm = std::clamp((db + kRangeDB) / kRangeDB, 0.f, 1.f);
+    return mRECT.B - norm * mRECT.H();
+  }
+
+  const SpectrumTap& mTap;
+  SpectrumAnalyzer mAnalyzer;
+  std::chrono::steady_clock::time_point mLastFrame;
+  MarkerFunc mMarkerFunc;
+  IColor mColor;
+  IColor mMarkerColor;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "CelestialSynth_DSP.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Offline stress run for the DSP core. Not part of the plugin build - include it from a scratch app or
+// test host. Built with CELESTIAL_RT_AUDIT=1 and CELESTIAL_RT_AUDIT_IMPLEMENT, everything the audio
+// thread would do here runs inside an audit scope, so any allocation, lock or blocking call is reported.
+// The driver source defines CELESTIAL_RT_AUDIT_IMPLEMENT, includes CelestialSynth_RealtimeAudit.h first
+// and then this header.
+
+struct CelestialStressResult
+{
+  int blocks = 0;
+  int midiMessages = 0;
+  int nonFiniteResets = 0; // NaN/Inf the DSP had to recover from, should stay 0
+  int auditViolations = 0; // real-time audit reports during the run, always 0 without CELESTIAL_RT_AUDIT
+};
+
+// Sweeps every setter the plugin calls from OnParamChange across its range while flooding the MIDI
+// input with notes, pedals and all-notes-off, over buses that connect and disconnect. Deterministic for a seed.
+template <typename T>
+CelestialStressResult StressCelestialDSP(uint32_t seed = 1, double sampleRate = 48000.0, int blockSize = 64, double seconds = 5.0)
+{
+  auto dsp = std::make_unique<CelestialSynthDSP<T>>();
+  dsp->Reset(sampleRate, blockSize);
+
+  constexpr int kChannels = 2 * CelestialSynthDSP<T>::kMaxBuses;
+  std::vector<T> buffers(kChannels * blockSize);
+  T* outputs[kChannels];
+  for (int c = 0; c < kChannels; c++)
+    outputs[c] = buffers.data() + c * blockSize;
+
+  uint32_t rng = seed ? seed : 1;
+  auto next = [&rng]() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+  };
+  auto unit = [&next]() { return (next() & 0xffffff) / double(0xffffff); };
+
+  CelestialStressResult result;
+#if CELESTIAL_RT_AUDIT
+  const int violationsBefore = CelestialRealtimeAudit::GetViolationCount();
+#endif
+
+  const int totalBlocks = (int)(seconds * sampleRate / blockSize);
+  for (int b = 0; b < totalBlocks; b++)
+  {
+    CELESTIAL_RT_AUDIT_SCOPE();
+
+    // One full sweep every couple of hundred blocks, each setter out of phase with the others
+    const double sweep = (b % 256) / 255.0;
+    switch (b % 16)
+    {
+      case 0: dsp->SetBrilliance(sweep); break;
+      case 1: dsp->SetMotion(sweep); break;
+      case 2: dsp->SetSpace(sweep); break;
+      case 3: dsp->SetWarmth(sweep); break;
+      case 4: dsp->SetPurity(sweep); break;
+      case 5: dsp->SetGravity(sweep); break;
+      case 6: dsp->SetGlideMode((b / 16) % CelestialSynthDSP<T>::kNumGlideModes); break;
+      case 7: dsp->SetScale((b / 16) % PentatonicScaleSystem::kNumScales); break;
+      case 8: dsp->SetWaveform((b / 16) % (int)WaveformType::kNumWaveforms); break;
+      case 9: dsp->SetTimbreShift(2.0 * sweep - 1.0); break;
+      case 10: dsp->SetVoiceCount(1 + (b / 16) % 16); break;
+      case 11: dsp->SetGain(sweep); break;
+      case 12: dsp->SetUnisonVoices(1 + (b / 16) % 4); dsp->SetUnisonDetune(50.0 * sweep); break;
+      case 13: dsp->SetRouting((b / 16) % CelestialSynthDSP<T>::kNumRoutings); break;
+      case 14: dsp->SetDelayMix(sweep); dsp->SetDelayFeedback(0.9 * sweep); dsp->SetDelayTime(2000.0 * sweep); break;
+      case 15: dsp->SetBusConnected(1 + (b / 16) % 3, (b / 48) % 2 == 0); break;
+    }
+
+    // Flood: up to 32 messages a block, mostly notes
+    const int numMessages = (int)(next() % 33);
+    for (int m = 0; m < numMessages; m++)
+    {
+      IMidiMsg msg;
+      const uint32_t r = next();
+      const int note = 24 + (int)(r % 84);
+      const int channel = (int)((r >> 8) % 16);
+      switch ((r >> 12) % 16)
+      {
+        case 0: msg.MakeControlChangeMsg(IMidiMsg::kSustainOnOff, (r >> 16) & 1 ? 1.0 : 0.0, channel); break;
+        case 1: msg.MakeControlChangeMsg(IMidiMsg::kSustenutoOnOff, (r >> 16) & 1 ? 1.0 : 0.0, channel); break;
+        case 2: msg.MakeControlChangeMsg(IMidiMsg::kAllNotesOff, 0.0, channel); break;
+        case 3: case 4: case 5: case 6: case 7: msg.MakeNoteOffMsg(note, 0, channel); break;
+        default: msg.MakeNoteOnMsg(note, 1 + (int)((r >> 16) % 127), 0, channel); break;
+      }
+      dsp->ProcessMidiMsg(msg);
+      result.midiMessages++;
+    }
+
+    // Odd block sizes too, the control rate sub-blocks and the convolution FIFO must cope
+    const int nFrames = (b % 7 == 3) ? 1 + (int)(unit() * (blockSize - 1)) : blockSize;
+    dsp->ProcessBlock(nullptr, outputs, 0, kChannels, nFrames);
+    result.blocks++;
+  }
+
+  result.nonFiniteResets = dsp->GetNonFiniteResetCount();
+#if CELESTIAL_RT_AUDIT
+  result.auditViolations = CelestialRealtimeAudit::GetViolationCount() - violationsBefore;
+#endif
+  return result;
+}
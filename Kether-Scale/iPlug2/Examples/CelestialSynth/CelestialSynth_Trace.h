@@ -0,0 +1,162 @@
+#pragma once
+
+// Scoped trace probes for profiling sessions. Off unless the build defines CELESTIAL_TRACE=1, and then
+// the macros at the bottom compile to nothing. With it on, each probe writes one event into a
+// lock-free ring owned by the calling thread, and CelestialTrace::WriteChromeJSON exports what the
+// rings still hold for chrome://tracing or ui.perfetto.dev.
+#ifndef CELESTIAL_TRACE
+#define CELESTIAL_TRACE 0
+#endif
+
+#if CELESTIAL_TRACE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+namespace CelestialTrace
+{
+static constexpr int kMaxThreads = 8;       // threads past this are not traced
+static constexpr int kRingEvents = 1 << 16; // per thread, about a second of a busy audio thread at 64 sample blocks
+
+// name must be a string literal, only the pointer is kept
+struct Event
+{
+  const char* name;
+  int64_t beginNs;
+  int64_t endNs;
+  int arg; // -1 for none
+};
+
+// Single writer: only the owning thread writes, the exporter reads up to written
+struct ThreadRing
+{
+  std::atomic<const char*> threadName {nullptr};
+  std::atomic<uint64_t> written {0};
+  Event events[kRingEvents];
+};
+
+inline ThreadRing* GetRings()
+{
+  static ThreadRing rings[kMaxThreads];
+  return rings;
+}
+
+inline std::atomic<int>& GetNumThreads()
+{
+  static std::atomic<int> numThreads {0};
+  return numThreads;
+}
+
+inline int64_t ToNs(std::chrono::steady_clock::time_point t)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+inline int64_t Now() { return ToNs(std::chrono::steady_clock::now()); }
+
+// The calling thread's ring, claimed on first use with one atomic add. nullptr once all are taken.
+inline ThreadRing* GetThreadRing()
+{
+  thread_local ThreadRing* ring = [] {
+    const int idx = GetNumThreads().fetch_add(1, std::memory_order_relaxed);
+    return idx < kMaxThreads ? &GetRings()[idx] : nullptr;
+  }();
+  return ring;
+}
+
+inline void Record(const char* name, int64_t beginNs, int64_t endNs, int arg = -1)
+{
+  ThreadRing* ring = GetThreadRing();
+  if (!ring)
+    return;
+
+  const uint64_t w = ring->written.load(std::memory_order_relaxed);
+  ring->events[w & (kRingEvents - 1)] = {name, beginNs, endNs, arg};
+  ring->written.store(w + 1, std::memory_order_release);
+}
+
+inline void SetThreadName(const char* name)
+{
+  if (ThreadRing* ring = GetThreadRing())
+    ring->threadName.store(name, std::memory_order_relaxed);
+}
+
+class Scope
+{
+public:
+  explicit Scope(const char* name, int arg = -1) : mName(name), mArg(arg), mBeginNs(Now()) {}
+  ~Scope() { Record(mName, mBeginNs, Now(), mArg); }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+private:
+  const char* mName;
+  int mArg;
+  int64_t mBeginNs;
+};
+
+// Writes the newest kRingEvents of every traced thread as Chrome trace JSON, times relative to the
+// oldest event. Any thread. Events written while this runs can come out torn, so for a clean trace
+// stop processing first.
+inline bool WriteChromeJSON(const char* path)
+{
+  FILE* fp = fopen(path, "w");
+  if (!fp)
+    return false;
+
+  const int numThreads = std::min(GetNumThreads().load(std::memory_order_relaxed), kMaxThreads);
+  ThreadRing* rings = GetRings();
+
+  uint64_t first[kMaxThreads], last[kMaxThreads];
+  int64_t originNs = INT64_MAX;
+  for (int t = 0; t < numThreads; t++)
+  {
+    last[t] = rings[t].written.load(std::memory_order_acquire);
+    first[t] = last[t] > (uint64_t)kRingEvents ? last[t] - kRingEvents : 0;
+    for (uint64_t i = first[t]; i < last[t]; i++)
+      originNs = std::min(originNs, rings[t].events[i & (kRingEvents - 1)].beginNs);
+  }
+
+  fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  const char* separator = "";
+  for (int t = 0; t < numThreads; t++)
+  {
+    const char* threadName = rings[t].threadName.load(std::memory_order_relaxed);
+    fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", separator, t, threadName ? threadName : "thread");
+    separator = ",\n";
+
+    for (uint64_t i = first[t]; i < last[t]; i++)
+    {
+      const Event& e = rings[t].events[i & (kRingEvents - 1)];
+      fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", separator, e.name, t,
+              (e.beginNs - originNs) * 1e-3, (e.endNs - e.beginNs) * 1e-3);
+      if (e.arg >= 0)
+        fprintf(fp, ",\"args\":{\"arg\":%d}", e.arg);
+      fprintf(fp, "}");
+    }
+  }
+  fprintf(fp, "\n]}\n");
+
+  return fclose(fp) == 0;
+}
+} // namespace CelestialTrace
+
+#define CELESTIAL_TRACE_CONCAT2(a, b) a##b
+#define CELESTIAL_TRACE_CONCAT(a, b) CELESTIAL_TRACE_CONCAT2(a, b)
+#define CELESTIAL_TRACE_SCOPE(name) CelestialTrace::Scope CELESTIAL_TRACE_CONCAT(celestialTrace, __LINE__)(name)
+#define CELESTIAL_TRACE_SCOPE_ARG(name, arg) CelestialTrace::Scope CELESTIAL_TRACE_CONCAT(celestialTrace, __LINE__)(name, (int)(arg))
+#define CELESTIAL_TRACE_EVENT(name, beginNs, endNs) CelestialTrace::Record(name, beginNs, endNs)
+#define CELESTIAL_TRACE_THREAD_NAME(name) CelestialTrace::SetThreadName(name)
+
+#else
+
+#define CELESTIAL_TRACE_SCOPE(name)
+#define CELESTIAL_TRACE_SCOPE_ARG(name, arg)
+#define CELESTIAL_TRACE_EVENT(name, beginNs, endNs)
+#define CELESTIAL_TRACE_THREAD_NAME(name)
+
+#endif
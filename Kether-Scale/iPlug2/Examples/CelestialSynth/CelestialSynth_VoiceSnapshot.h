@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+
+// Single writer, single reader triple buffer. Both sides are wait-free: the writer fills its own
+// slot and swaps it into the middle, the reader swaps the middle out only when something new is there.
+template <typename S>
+class TripleBuffer
+{
+public:
+  // Writer
+  S& GetWriteSlot() { return mSlots[mWriteIdx]; }
+  void Publish() { mWriteIdx = mMiddle.exchange(mWriteIdx | kFresh, std::memory_order_acq_rel) & kIndexMask; }
+
+  // Reader: moves to the newest published slot, false if nothing was published since the last call
+  bool Acquire()
+  {
+    if (!(mMiddle.load(std::memory_order_relaxed) & kFresh))
+      return false;
+
+    mReadIdx = mMiddle.exchange(mReadIdx, std::memory_order_acq_rel) & kIndexMask;
+    return true;
+  }
+
+  const S& GetReadSlot() const { return mSlots[mReadIdx]; }
+
+private:
+  static constexpr int kIndexMask = 3;
+  static constexpr int kFresh = 4;
+
+  S mSlots[3] = {};
+  int mWriteIdx = 0;
+  std::atomic<int> mMiddle {1};
+  int mReadIdx = 2;
+};
+
+// What the UI gets to see of a sounding voice
+struct CelestialVoiceState
+{
+  int note;
+  int degree;  // 0-4 within the pentatonic scale
+  float level; // envelope, 0-1
+  float pan;   // -1 to 1
+  int bus;
+};
+
+struct CelestialVoiceSnapshot
+{
+  static constexpr int kMaxVoices = 32;
+
+  int numVoices = 0;
+  CelestialVoiceState voices[kMaxVoices] = {};
+};